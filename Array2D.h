@@ -3,9 +3,53 @@
 
 #include <stdint.h>
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <cassert>
+#include <new>
+#include <utility>
 
-// A dynamic 2d array.
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Alignment (in bytes) of the element block and of every row.
+#define ARRAY2D_ALIGNMENT 64
+
+// Size (in bytes) of a huge page used for optional huge page backing.
+#define ARRAY2D_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Allocation flags accepted by resize.
+enum Array2DFlags_t
+{
+	ARRAY2D_DEFAULT    = 0,
+	ARRAY2D_HUGE_PAGES = (1 << 0), // Back the element block with huge pages when available
+	ARRAY2D_NO_FILL    = (1 << 1)  // Leave the element block uninitialized (and untouched)
+};
+
+// A non-owning view of a rectangular region of a 2d array.
+template<class T>
+struct Array2DView
+{
+	T *origin;     // Pointer to the top-left element
+	size_t width;  // Number of columns
+	size_t height; // Number of rows
+	size_t stride; // Distance in elements between the start of consecutive rows
+
+	// Return a pointer to the y'th row of the view. No bounds checking.
+	T* operator[](size_t y) const { return origin + (y * stride); }
+
+	// Return a sub-region of the view. No bounds checking.
+	Array2DView region(size_t x, size_t y, size_t w, size_t h) const
+	{
+		Array2DView result = {origin + (y * stride) + x, w, h, stride};
+		return result;
+	}
+};
+
+// A dynamic 2d array stored in a single contiguous, aligned allocation.
+// Rows are padded so that each one starts on an ARRAY2D_ALIGNMENT boundary.
+// T must be trivially copyable; copies are done with memcpy.
 template<class T>
 class Array2D
 {
@@ -15,28 +59,52 @@ public:
 	inline Array2D();
 
 	// Construct a 2d array with the given width and height.
-	inline Array2D(size_t width, size_t height);
+	inline Array2D(size_t width, size_t height, size_t padding = 0, int flags = ARRAY2D_DEFAULT);
 
 	// Copy construct from anouther 2d array.
 	inline Array2D(const Array2D<T> &other);
 
+	// Move construct from anouther 2d array. Leaves the other array invalid.
+	inline Array2D(Array2D<T> &&other);
+
 	// Copy from anouther array. May resize this array.
 	inline const Array2D &operator=(const Array2D &other);
 
+	// Take ownership of anouther array's storage. Leaves the other array invalid.
+	inline const Array2D &operator=(Array2D &&other);
+
 	// Dtor.
 	inline ~Array2D(void);
 
-	// Destructively resize the 2d array.
-	inline void resize(size_t width, size_t height);
+	// Destructively resize the 2d array. Each row is followed by at least
+	// padding extra elements, rounded up so rows stay aligned. The element
+	// block (including padding) is zero filled unless ARRAY2D_NO_FILL is given,
+	// in which case its pages are first touched by whoever writes them.
+	inline void resize(size_t width, size_t height, size_t padding = 0, int flags = ARRAY2D_DEFAULT);
+
+	// Exchange storage with anouther array.
+	inline void swap(Array2D<T> &other);
 
 	// Return the number of columns.
 	inline size_t width() const;
 
 	// Return the number of rows.
 	inline size_t height() const;
-	
+
+	// Return the distance in elements between the start of consecutive rows.
+	inline size_t stride() const;
+
+	// Return the number of elements in the element block (stride * height).
+	inline size_t capacity() const;
+
+	// Return true if huge page backing was requested for the element block.
+	inline bool huge_pages() const;
+
 	// Return a pointer to the data store.
-	inline T** data();
+	inline T* data();
+
+	// Return a const pointer to the data store.
+	inline const T* data() const;
 
 	// Return a reference to the element at the location. Bounds checked.
 	inline T& at(size_t x, size_t y);
@@ -50,51 +118,88 @@ public:
 	// Return a const pointer to the y'th row. No bounds checking.
 	inline const T* operator[](size_t y) const;
 
+	// Return a view of the whole array.
+	inline Array2DView<T> view();
+
+	// Return a const view of the whole array.
+	inline Array2DView<const T> view() const;
+
+	// Return a view of a region of the array. Bounds checked.
+	inline Array2DView<T> region(size_t x, size_t y, size_t width, size_t height);
+
+	// Return a const view of a region of the array. Bounds checked.
+	inline Array2DView<const T> region(size_t x, size_t y, size_t width, size_t height) const;
+
 private:
 
 	// Frees resources and invalidates the array.
 	void release();
 
+	// Copy the elements of an array with identical dimensions.
+	void copy_elements(const Array2D &other);
+
 	size_t _width;
 	size_t _height;
-	T** _array;
+	size_t _stride;
+	size_t _padding;
+	size_t _mapped_bytes; // Non-zero when the block was obtained with mmap
+	int _flags;
+	T* _array;
 };
 
 template<class T>
 Array2D<T>::Array2D() :
 	_width(0),
 	_height(0),
+	_stride(0),
+	_padding(0),
+	_mapped_bytes(0),
+	_flags(ARRAY2D_DEFAULT),
 	_array(NULL)
 {
 }
 
 template<class T>
-Array2D<T>::Array2D(size_t width, size_t height) :
+Array2D<T>::Array2D(size_t width, size_t height, size_t padding, int flags) :
 	_width(0),
 	_height(0),
+	_stride(0),
+	_padding(0),
+	_mapped_bytes(0),
+	_flags(ARRAY2D_DEFAULT),
 	_array(NULL)
 {
-	resize(width, height);
+	resize(width, height, padding, flags);
 }
 
 template<class T>
 Array2D<T>::Array2D(const Array2D<T> &other) :
 	_width(0),
 	_height(0),
+	_stride(0),
+	_padding(0),
+	_mapped_bytes(0),
+	_flags(ARRAY2D_DEFAULT),
 	_array(NULL)
 {
-	if((other.width() != width()) || (other.height() != height()))
+	if(other._array != NULL)
 	{
-		resize(other.width(), other.height());
+		resize(other.width(), other.height(), other._padding, other._flags);
+		copy_elements(other);
 	}
+}
 
-	for(size_t y = 0; y < height(); y++)
-	{
-		for(size_t x = 0; x < width(); x++)
-		{
-			at(x, y) = other.at(x, y);
-		}
-	}
+template<class T>
+Array2D<T>::Array2D(Array2D<T> &&other) :
+	_width(0),
+	_height(0),
+	_stride(0),
+	_padding(0),
+	_mapped_bytes(0),
+	_flags(ARRAY2D_DEFAULT),
+	_array(NULL)
+{
+	swap(other);
 }
 
 template<class T>
@@ -102,18 +207,30 @@ const Array2D<T> &Array2D<T>::operator=(const Array2D<T> &other)
 {
 	if(this != &other)
 	{
-		if((other.width() != width()) || (other.height() != height()))
+		if(other._array == NULL)
 		{
-			resize(other.width(), other.height());
+			release();
+			return *this;
 		}
 
-		for(size_t y = 0; y < height(); y++)
+		if((other.width() != width()) || (other.height() != height()))
 		{
-			for(size_t x = 0; x < width(); x++)
-			{
-				at(x, y) = other.at(x, y);
-			}
+			resize(other.width(), other.height(), other._padding, other._flags);
 		}
+
+		copy_elements(other);
+	}
+
+	return *this;
+}
+
+template<class T>
+const Array2D<T> &Array2D<T>::operator=(Array2D<T> &&other)
+{
+	if(this != &other)
+	{
+		release();
+		swap(other);
 	}
 
 	return *this;
@@ -126,23 +243,65 @@ Array2D<T>::~Array2D(void)
 }
 
 template<class T>
-void Array2D<T>::resize(size_t width, size_t height)
+void Array2D<T>::resize(size_t width, size_t height, size_t padding, int flags)
 {
 	assert(width > 0);
 	assert(height > 0);
+	assert((ARRAY2D_ALIGNMENT % sizeof(T)) == 0);
 
 	release();
 
+	const size_t row_align = ARRAY2D_ALIGNMENT / sizeof(T);
 	_width = width;
 	_height = height;
+	_padding = padding;
+	_flags = flags;
+	_stride = ((width + padding + row_align - 1) / row_align) * row_align;
 
-	_array = new T*[sizeof(T*) * _height];
+	size_t bytes = _stride * _height * sizeof(T);
+	void *block = NULL;
 
-	T* elements = new T[width * height];
-	for(size_t y = 0; y < _height; y++)
+#ifdef __linux__
+	if(flags & ARRAY2D_HUGE_PAGES)
 	{
-		_array[y] = &elements[y * _width]; 
+		size_t mapped = ((bytes + ARRAY2D_HUGE_PAGE_SIZE - 1) / ARRAY2D_HUGE_PAGE_SIZE) * ARRAY2D_HUGE_PAGE_SIZE;
+		block = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(block == MAP_FAILED)
+		{
+			// No reserved huge pages; ask for transparent huge pages instead.
+			block = NULL;
+			if(posix_memalign(&block, ARRAY2D_HUGE_PAGE_SIZE, mapped) != 0)
+				throw std::bad_alloc();
+			madvise(block, mapped, MADV_HUGEPAGE);
+		}
+		else
+		{
+			_mapped_bytes = mapped;
+		}
 	}
+#endif
+
+	if(block == NULL)
+	{
+		if(posix_memalign(&block, ARRAY2D_ALIGNMENT, bytes) != 0)
+			throw std::bad_alloc();
+	}
+
+	_array = static_cast<T*>(block);
+	if(!(flags & ARRAY2D_NO_FILL))
+		memset(_array, 0, bytes);
+}
+
+template<class T>
+void Array2D<T>::swap(Array2D<T> &other)
+{
+	std::swap(_width, other._width);
+	std::swap(_height, other._height);
+	std::swap(_stride, other._stride);
+	std::swap(_padding, other._padding);
+	std::swap(_mapped_bytes, other._mapped_bytes);
+	std::swap(_flags, other._flags);
+	std::swap(_array, other._array);
 }
 
 template<class T>
@@ -158,7 +317,31 @@ size_t Array2D<T>::height() const
 }
 
 template<class T>
-T** Array2D<T>::data()
+size_t Array2D<T>::stride() const
+{
+	return _stride;
+}
+
+template<class T>
+size_t Array2D<T>::capacity() const
+{
+	return _stride * _height;
+}
+
+template<class T>
+bool Array2D<T>::huge_pages() const
+{
+	return (_array != NULL) && (_flags & ARRAY2D_HUGE_PAGES);
+}
+
+template<class T>
+T* Array2D<T>::data()
+{
+	return _array;
+}
+
+template<class T>
+const T* Array2D<T>::data() const
 {
 	return _array;
 }
@@ -184,13 +367,62 @@ const T& Array2D<T>::at(size_t x, size_t y) const
 template<class T>
 T* Array2D<T>::operator[](size_t y)
 {
-	return _array[y];
+	return _array + (y * _stride);
 }
 
 template<class T>
 const T* Array2D<T>::operator[](size_t y) const
 {
-	return _array[y];
+	return _array + (y * _stride);
+}
+
+template<class T>
+Array2DView<T> Array2D<T>::view()
+{
+	Array2DView<T> result = {_array, _width, _height, _stride};
+	return result;
+}
+
+template<class T>
+Array2DView<const T> Array2D<T>::view() const
+{
+	Array2DView<const T> result = {_array, _width, _height, _stride};
+	return result;
+}
+
+template<class T>
+Array2DView<T> Array2D<T>::region(size_t x, size_t y, size_t width, size_t height)
+{
+	assert(x + width <= _width);
+	assert(y + height <= _height);
+	return view().region(x, y, width, height);
+}
+
+template<class T>
+Array2DView<const T> Array2D<T>::region(size_t x, size_t y, size_t width, size_t height) const
+{
+	assert(x + width <= _width);
+	assert(y + height <= _height);
+	return view().region(x, y, width, height);
+}
+
+template<class T>
+void Array2D<T>::copy_elements(const Array2D<T> &other)
+{
+	assert(other.width() == width());
+	assert(other.height() == height());
+
+	if(other.stride() == stride())
+	{
+		memcpy(_array, other._array, capacity() * sizeof(T));
+	}
+	else
+	{
+		for(size_t y = 0; y < height(); y++)
+		{
+			memcpy((*this)[y], other[y], width() * sizeof(T));
+		}
+	}
 }
 
 template<class T>
@@ -198,12 +430,20 @@ void Array2D<T>::release()
 {
 	if(data() != NULL)
 	{
-		delete [] _array[0];
-		delete [] _array;
+#ifdef __linux__
+		if(_mapped_bytes != 0)
+			munmap(_array, _mapped_bytes);
+		else
+#endif
+			free(_array);
 	}
 
 	_width = 0;
 	_height = 0;
+	_stride = 0;
+	_padding = 0;
+	_mapped_bytes = 0;
+	_flags = ARRAY2D_DEFAULT;
 	_array = NULL;
 }
 
@@ -11,6 +11,8 @@
 #include "AsyncIO.h"
 #include <sstream>
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
 inline bool valid(const std::pair<int32_t, int32_t> &loc, const Topology_t &topology)
 {
@@ -40,270 +42,354 @@ inline void dump_coord(const std::pair<int32_t, int32_t> &coord, int32_t rank)
 
 AsyncIO::AsyncIO(
 	LifeBoard &board,
-	const std::pair<size_t, size_t> &topology) :
+	const std::pair<size_t, size_t> &topology,
+	size_t depth,
+	MPI_Comm comm,
+	bool compress) :
+	_board(board),
+	_comm(comm),
+	_compress(compress),
+	_present(0),
+	_arrived(0),
+	_bytes_sent(0),
+	_raw_bytes_sent(0),
 	_links(0)
 {
+	const size_t d = depth;
+	const size_t w = board.width();
+	const size_t h = board.height();
+
 	int32_t local_rank;
 	std::pair<int32_t, int32_t> local_coord;
 	std::pair<int32_t, int32_t> coord; 
 
-	MPI_Comm_rank(MPI_COMM_WORLD, &local_rank);
+	MPI_Comm_rank(comm, &local_rank);
 	local_coord = map(local_rank, topology);
 
-	// Construct types for sending rows and columns
+	// Construct types for sending rows and corners in place
 	MPI_Type_vector(
-		board.height() - 2,
-		1,
-		board.width(),
+		d,
+		w - (2 * d),
+		board.stride(),
 		MPI_CHAR,
-		&_columnType);
+		&_rowType);
 	MPI_Type_vector(
-		1,
-		board.width() - 2,
-		1,
+		d,
+		d,
+		board.stride(),
 		MPI_CHAR,
-		&_rowType);
-	MPI_Type_commit(&_columnType);
+		&_cornerType);
 	MPI_Type_commit(&_rowType);
+	MPI_Type_commit(&_cornerType);
 
 	// NW
 	coord = std::make_pair(local_coord.first - 1, local_coord.second - 1);
 	if(valid(coord, topology))
 	{
-		int32_t rank = map(coord, topology);
-
-		MPI_Send_init(
-			&board[1][1],
-			1,
-			MPI_CHAR,
-			rank,
-			0,
-			MPI_COMM_WORLD,
-			&_send_requests[_links]);
-		
-		MPI_Recv_init(
-			&board[0][0],
-			1,
-			MPI_CHAR,
-			rank,
-			MPI_ANY_TAG,
-			MPI_COMM_WORLD,
-			&_recv_requests[_links]);
-
-		_links++;
+		Region_t send = {d, d, d, d};
+		Region_t recv = {0, 0, d, d};
+		add_link(map(coord, topology), HALO_NW, send, recv, _cornerType);
 	}
 
 	// NE
 	coord = std::make_pair(local_coord.first + 1, local_coord.second - 1);	
 	if(valid(coord, topology))
 	{
-		int32_t rank = map(coord, topology);
-
-		MPI_Send_init(
-			&board[1][board.width() - 2],
-			1,
-			MPI_CHAR,
-			rank,
-			0,
-			MPI_COMM_WORLD,
-			&_send_requests[_links]);
-		
-		MPI_Recv_init(
-			&board[0][board.width() - 1],
-			1,
-			MPI_CHAR,
-			rank,
-			MPI_ANY_TAG,
-			MPI_COMM_WORLD,
-			&_recv_requests[_links]);
-
-		_links++;
+		Region_t send = {w - (2 * d), d, d, d};
+		Region_t recv = {w - d, 0, d, d};
+		add_link(map(coord, topology), HALO_NE, send, recv, _cornerType);
 	}
 
 	// SE
 	coord = std::make_pair(local_coord.first + 1, local_coord.second + 1);	
 	if(valid(coord, topology))
 	{
-		int32_t rank = map(coord, topology);
-
-		MPI_Send_init(
-			&board[board.height() - 2][board.width() - 2],
-			1,
-			MPI_CHAR,
-			rank,
-			0,
-			MPI_COMM_WORLD,
-			&_send_requests[_links]);
-		
-		MPI_Recv_init(
-			&board[board.height() - 1][board.width() - 1],
-			1,
-			MPI_CHAR,
-			rank,
-			MPI_ANY_TAG,
-			MPI_COMM_WORLD,
-			&_recv_requests[_links]);
-
-		_links++;
+		Region_t send = {w - (2 * d), h - (2 * d), d, d};
+		Region_t recv = {w - d, h - d, d, d};
+		add_link(map(coord, topology), HALO_SE, send, recv, _cornerType);
 	}
 
 	// SW
 	coord = std::make_pair(local_coord.first - 1, local_coord.second + 1);	
 	if(valid(coord, topology))
 	{
-		int32_t rank = map(coord, topology);
-
-		MPI_Send_init(
-			&board[board.height() - 2][1],
-			1,
-			MPI_CHAR,
-			rank,
-			0,
-			MPI_COMM_WORLD,
-			&_send_requests[_links]);
-		
-		MPI_Recv_init(
-			&board[board.height() - 1][0],
-			1,
-			MPI_CHAR,
-			rank,
-			MPI_ANY_TAG,
-			MPI_COMM_WORLD,
-			&_recv_requests[_links]);
-
-		_links++;
+		Region_t send = {d, h - (2 * d), d, d};
+		Region_t recv = {0, h - d, d, d};
+		add_link(map(coord, topology), HALO_SW, send, recv, _cornerType);
 	}
 
 	// N
 	coord = std::make_pair(local_coord.first, local_coord.second - 1);
 	if(valid(coord, topology))
 	{
-		int32_t rank = map(coord, topology);
-
-		MPI_Send_init(
-			&board[1][1],
-			1,
-			_rowType,
-			rank,
-			0,
-			MPI_COMM_WORLD,
-			&_send_requests[_links]);
-
-		MPI_Recv_init(
-			&board[0][1],
-			1,
-			_rowType,
-			rank,
-			MPI_ANY_TAG,
-			MPI_COMM_WORLD,
-			&_recv_requests[_links]);
-
-		_links++;
+		Region_t send = {d, d, w - (2 * d), d};
+		Region_t recv = {d, 0, w - (2 * d), d};
+		add_link(map(coord, topology), HALO_N, send, recv, _rowType);
 	}
 
 	// S
 	coord = std::make_pair(local_coord.first, local_coord.second + 1);
 	if(valid(coord, topology))
 	{
-		int32_t rank = map(coord, topology);
-
-		MPI_Send_init(
-			&board[board.height() - 2][1],
-			1,
-			_rowType,
-			rank,
-			0,
-			MPI_COMM_WORLD,
-			&_send_requests[_links]);
-
-		MPI_Recv_init(
-			&board[board.height() - 1][1],
-			1,
-			_rowType,
-			rank,
-			MPI_ANY_TAG,
-			MPI_COMM_WORLD,
-			&_recv_requests[_links]);
-
-		_links++;
+		Region_t send = {d, h - (2 * d), w - (2 * d), d};
+		Region_t recv = {d, h - d, w - (2 * d), d};
+		add_link(map(coord, topology), HALO_S, send, recv, _rowType);
 	}	
 
 	// E
 	coord = std::make_pair(local_coord.first + 1, local_coord.second);
 	if(valid(coord, topology))
 	{
-		int32_t rank = map(coord, topology);
+		Region_t send = {w - (2 * d), d, d, h - (2 * d)};
+		Region_t recv = {w - d, d, d, h - (2 * d)};
+		add_link(map(coord, topology), HALO_E, send, recv, MPI_DATATYPE_NULL);
+	}
+
+	// W
+	coord = std::make_pair(local_coord.first - 1, local_coord.second);
+	if(valid(coord, topology))
+	{
+		Region_t send = {d, d, d, h - (2 * d)};
+		Region_t recv = {0, d, d, h - (2 * d)};
+		add_link(map(coord, topology), HALO_W, send, recv, MPI_DATATYPE_NULL);
+	}
+}
+
+AsyncIO::~AsyncIO()
+{
+	// Compressed messages use one-shot requests, which are freed on completion
+	for(size_t i = 0; (i < _links) && !_compress; i++)
+	{
+		MPI_Request_free(&_send_requests[i]);
+		MPI_Request_free(&_recv_requests[i]);
+	}
+	
+	MPI_Type_free(&_rowType);
+	MPI_Type_free(&_cornerType);
+}
+
+void AsyncIO::add_link(
+	int32_t rank,
+	uint32_t direction,
+	const Region_t &send,
+	const Region_t &recv,
+	MPI_Datatype type)
+{
+	size_t cells = send.width * send.height;
+
+	_ranks[_links] = rank;
+	_directions[_links] = direction;
+	_send_regions[_links] = send;
+	_recv_regions[_links] = recv;
+	_has_sent[_links] = false;
+	_packed[_links] = !_compress && (type == MPI_DATATYPE_NULL);
+	_mirrored[_links] = 0;
+	_send_requests[_links] = MPI_REQUEST_NULL;
+	_recv_requests[_links] = MPI_REQUEST_NULL;
+
+	if(_compress)
+	{
+		// A message is never larger than its bit-packed form plus the encoding
+		_send_buffers[_links].resize(1 + ((cells + 7) / 8));
+		_recv_buffers[_links].resize(1 + ((cells + 7) / 8));
+		_sent[_links].resize(cells);
+	}
+	else if(_packed[_links])
+	{
+		_send_buffers[_links].resize(cells);
+		_recv_buffers[_links].resize(cells);
 
 		MPI_Send_init(
-			&board[1][board.width() - 2],
-			1,
-			_columnType,
+			&_send_buffers[_links][0],
+			cells,
+			MPI_BYTE,
 			rank,
 			0,
-			MPI_COMM_WORLD,
+			_comm,
 			&_send_requests[_links]);
 
 		MPI_Recv_init(
-			&board[1][board.width() - 1],
-			1,
-			_columnType,
+			&_recv_buffers[_links][0],
+			cells,
+			MPI_BYTE,
 			rank,
 			MPI_ANY_TAG,
-			MPI_COMM_WORLD,
+			_comm,
 			&_recv_requests[_links]);
-
-		_links++;
 	}
-
-	// W
-	coord = std::make_pair(local_coord.first - 1, local_coord.second);
-	if(valid(coord, topology))
+	else
 	{
-		int32_t rank = map(coord, topology);
-
 		MPI_Send_init(
-			&board[1][1],
+			&_board[send.y_start][send.x_start],
 			1,
-			_columnType,
+			type,
 			rank,
 			0,
-			MPI_COMM_WORLD,
+			_comm,
 			&_send_requests[_links]);
 
 		MPI_Recv_init(
-			&board[1][0],
+			&_board[recv.y_start][recv.x_start],
 			1,
-			_columnType,
+			type,
 			rank,
 			MPI_ANY_TAG,
-			MPI_COMM_WORLD,
+			_comm,
 			&_recv_requests[_links]);
-
-		_links++;
 	}
+
+	_present |= direction;
+	_links++;
 }
 
-AsyncIO::~AsyncIO()
+void AsyncIO::mirror(const Region_t &written)
 {
 	for(size_t i = 0; i < _links; i++)
 	{
-		MPI_Request_free(&_send_requests[i]);
-		MPI_Request_free(&_recv_requests[i]);
+		if(!_packed[i])
+			continue;
+
+		const Region_t &region = _send_regions[i];
+		size_t y0 = std::max(written.y_start, region.y_start);
+		size_t y1 = std::min(written.y_start + written.height, region.y_start + region.height);
+		bool covers =
+			(written.x_start <= region.x_start) &&
+			(written.x_start + written.width >= region.x_start + region.width);
+		if(!covers || y0 >= y1)
+			continue;
+
+		pack(i, y0 - region.y_start, y1 - y0);
+		_mirrored[i] += y1 - y0;
+	}
+}
+
+void AsyncIO::pack(size_t link, size_t y_start, size_t height)
+{
+	const Region_t &region = _send_regions[link];
+	uint8_t *out = &_send_buffers[link][y_start * region.width];
+
+	for(size_t y = y_start; y < y_start + height; y++, out += region.width)
+	{
+		memcpy(out, &_board[region.y_start + y][region.x_start], region.width * sizeof(bool));
 	}
-	
-	MPI_Type_free(&_columnType);
-	MPI_Type_free(&_rowType);
 }
 
 void AsyncIO::begin()
 {
-	MPI_Startall(_links, _send_requests);
-	MPI_Startall(_links, _recv_requests);
+	_arrived = 0;
+
+	if(!_compress)
+	{
+		// Refresh column mirrors the board was not written through
+		for(size_t i = 0; i < _links; i++)
+		{
+			if(_packed[i] && _mirrored[i] != _send_regions[i].height)
+				pack(i, 0, _send_regions[i].height);
+			_mirrored[i] = 0;
+		}
+
+		MPI_Startall(_links, _send_requests);
+		MPI_Startall(_links, _recv_requests);
+
+		for(size_t i = 0; i < _links; i++)
+		{
+			size_t bytes = _send_regions[i].width * _send_regions[i].height;
+			_bytes_sent += bytes;
+			_raw_bytes_sent += bytes;
+		}
+		return;
+	}
+
+	for(size_t i = 0; i < _links; i++)
+	{
+		MPI_Irecv(
+			&_recv_buffers[i][0],
+			_recv_buffers[i].size(),
+			MPI_BYTE,
+			_ranks[i],
+			MPI_ANY_TAG,
+			_comm,
+			&_recv_requests[i]);
+	}
+
+	for(size_t i = 0; i < _links; i++)
+	{
+		size_t bytes = encode(i);
+		_bytes_sent += bytes;
+		_raw_bytes_sent += _send_regions[i].width * _send_regions[i].height;
+
+		MPI_Isend(
+			&_send_buffers[i][0],
+			bytes,
+			MPI_BYTE,
+			_ranks[i],
+			0,
+			_comm,
+			&_send_requests[i]);
+	}
+}
+
+void AsyncIO::complete(int32_t count, const int32_t *indices)
+{
+	for(int32_t i = 0; (count != MPI_UNDEFINED) && (i < count); i++)
+	{
+		if(_compress)
+		{
+			decode(indices[i]);
+		}
+		else if(_packed[indices[i]])
+		{
+			const Region_t &region = _recv_regions[indices[i]];
+			const uint8_t *in = &_recv_buffers[indices[i]][0];
+			for(size_t y = 0; y < region.height; y++, in += region.width)
+			{
+				memcpy(&_board[region.y_start + y][region.x_start], in, region.width * sizeof(bool));
+			}
+		}
+		_arrived |= _directions[indices[i]];
+	}
+}
+
+void AsyncIO::progress()
+{
+	int32_t count;
+	int32_t indices[8];
+	int32_t flag;
+
+	MPI_Testsome(_links, _recv_requests, &count, indices, _statuses);
+	complete(count, indices);
+
+	MPI_Testall(_links, _send_requests, &flag, MPI_STATUSES_IGNORE);
+}
+
+void AsyncIO::wait_some()
+{
+	int32_t count;
+	int32_t indices[8];
+
+	MPI_Waitsome(_links, _recv_requests, &count, indices, _statuses);
+	complete(count, indices);
+}
+
+bool AsyncIO::arrived(uint32_t mask) const
+{
+	return ((_arrived | ~_present) & mask) == mask;
+}
+
+bool AsyncIO::sent()
+{
+	int32_t flag;
+
+	MPI_Testall(_links, _send_requests, &flag, MPI_STATUSES_IGNORE);
+	return flag;
 }
 
 void AsyncIO::end()
 {
-	MPI_Waitall(_links, _recv_requests, _statuses);
+	while(!arrived(_present))
+	{
+		wait_some();
+	}
 	MPI_Waitall(_links, _send_requests, _statuses);
 }
 	
@@ -311,3 +397,147 @@ size_t AsyncIO::links() const
 {
 	return _links;
 }
+
+uint64_t AsyncIO::bytes_sent() const
+{
+	return _bytes_sent;
+}
+
+uint64_t AsyncIO::raw_bytes_sent() const
+{
+	return _raw_bytes_sent;
+}
+
+size_t AsyncIO::encode(size_t link)
+{
+	const Region_t &region = _send_regions[link];
+	const size_t cells = region.width * region.height;
+	uint8_t *out = &_send_buffers[link][0];
+	std::vector<uint8_t> &plain = _sent[link];
+	bool empty = true;
+	bool unchanged = _has_sent[link];
+
+	// Gather the region, comparing against the previous message as we go
+	for(size_t y = 0, i = 0; y < region.height; y++)
+	{
+		const bool *row = &_board[region.y_start + y][region.x_start];
+		for(size_t x = 0; x < region.width; x++, i++)
+		{
+			uint8_t cell = row[x];
+			unchanged = unchanged && (plain[i] == cell);
+			empty = empty && (cell == 0);
+			plain[i] = cell;
+		}
+	}
+	_has_sent[link] = true;
+
+	if(unchanged)
+	{
+		out[0] = ENCODING_UNCHANGED;
+		return 1;
+	}
+	if(empty)
+	{
+		out[0] = ENCODING_EMPTY;
+		return 1;
+	}
+
+	// Try run lengths first, giving up once they are no smaller than bits
+	const size_t bits_size = 1 + ((cells + 7) / 8);
+	size_t size = 1;
+	uint8_t state = 0;
+	for(size_t i = 0; i < cells && size < bits_size; )
+	{
+		size_t run = 0;
+		while((i < cells) && (plain[i] == state))
+		{
+			run++;
+			i++;
+		}
+		state = !state;
+
+		do
+		{
+			uint8_t byte = run & 0x7f;
+			run >>= 7;
+			if(size < bits_size)
+				out[size] = byte | (run ? 0x80 : 0);
+			size++;
+		} while(run);
+	}
+
+	if(size < bits_size)
+	{
+		out[0] = ENCODING_RUNS;
+		return size;
+	}
+
+	out[0] = ENCODING_BITS;
+	memset(out + 1, 0, bits_size - 1);
+	for(size_t i = 0; i < cells; i++)
+	{
+		out[1 + (i / 8)] |= plain[i] << (i % 8);
+	}
+	return bits_size;
+}
+
+void AsyncIO::decode(size_t link)
+{
+	const Region_t &region = _recv_regions[link];
+	const uint8_t *in = &_recv_buffers[link][0];
+
+	switch(in[0])
+	{
+	case ENCODING_UNCHANGED:
+		// The ghost cells still hold the previous message
+		break;
+
+	case ENCODING_EMPTY:
+		for(size_t y = 0; y < region.height; y++)
+		{
+			memset(&_board[region.y_start + y][region.x_start], 0, region.width * sizeof(bool));
+		}
+		break;
+
+	case ENCODING_BITS:
+		for(size_t y = 0, i = 0; y < region.height; y++)
+		{
+			bool *row = &_board[region.y_start + y][region.x_start];
+			for(size_t x = 0; x < region.width; x++, i++)
+			{
+				row[x] = (in[1 + (i / 8)] >> (i % 8)) & 1;
+			}
+		}
+		break;
+
+	case ENCODING_RUNS:
+		{
+			const uint8_t *next = in + 1;
+			size_t run = 0;
+			bool state = true;
+			for(size_t y = 0; y < region.height; y++)
+			{
+				bool *row = &_board[region.y_start + y][region.x_start];
+				for(size_t x = 0; x < region.width; x++)
+				{
+					// Read run lengths until one is non-empty, flipping state each time
+					while(run == 0)
+					{
+						size_t shift = 0;
+						uint8_t byte;
+						do
+						{
+							byte = *next++;
+							run |= (size_t)(byte & 0x7f) << shift;
+							shift += 7;
+						} while(byte & 0x80);
+						state = !state;
+					}
+					row[x] = state;
+					run--;
+				}
+			}
+		}
+		break;
+	}
+}
@@ -12,6 +12,7 @@
  */
 
 #include <mpi.h>
+#include <vector>
 #include "LifeUtil.h"
 
 // Alias the type used to represent topology.
@@ -21,29 +22,117 @@ typedef std::pair<size_t, size_t> Topology_t;
 class AsyncIO
 {
 public:
-	// Bind to a board for the provided topology.
+	// Halo directions, used as bits of a mask.
+	enum Direction_t
+	{
+		HALO_NW = (1 << 0),
+		HALO_NE = (1 << 1),
+		HALO_SE = (1 << 2),
+		HALO_SW = (1 << 3),
+		HALO_N  = (1 << 4),
+		HALO_S  = (1 << 5),
+		HALO_E  = (1 << 6),
+		HALO_W  = (1 << 7)
+	};
+
+	// Encodings of a compressed halo message, stored in its first byte.
+	enum Encoding_t
+	{
+		ENCODING_EMPTY     = 0, // Every cell is dead; no payload
+		ENCODING_UNCHANGED = 1, // Same cells as the previous message; no payload
+		ENCODING_BITS      = 2, // One bit per cell
+		ENCODING_RUNS      = 3  // Varint run lengths, alternating dead and alive
+	};
+
+	// Bind to a board for the provided topology. The board carries a margin
+	// of depth ghost rows/columns on each side, which is exchanged in full.
+	// With compress set, each message is packed and sent in the smallest of
+	// the encodings above instead of being sent in place. Otherwise rows and
+	// corners are sent in place, and the east and west columns are sent from
+	// and received into contiguous mirrors, so no datatype packing is done.
 	AsyncIO(
 		LifeBoard &board,
-		const Topology_t &topology);
+		const Topology_t &topology,
+		size_t depth = 1,
+		MPI_Comm comm = MPI_COMM_WORLD,
+		bool compress = false);
 
 	// Dtor.
 	~AsyncIO();
 
+	// Copy the cells of a region just written to the board into the column
+	// mirrors they belong to. A mirror that was not completely refreshed this
+	// way since the last begin is copied from the board in full by begin.
+	void mirror(const Region_t &written);
+
 	// Begin async communication.
 	void begin();
 
-	// Wait for the async communication to complete.
+	// Drive communication without blocking and note any halos that arrived.
+	void progress();
+
+	// Block until at least one more halo arrives. Returns at once if all have.
+	void wait_some();
+
+	// Return true if every halo in the mask has arrived or has no sender.
+	bool arrived(uint32_t mask) const;
+
+	// Return true once every send has completed, testing them without blocking.
+	bool sent();
+
+	// Wait for the async communication to complete. Returns at once if it has.
 	void end();
 
 	// Number of processors we depend on.
 	size_t links() const;
 
+	// Bytes sent since construction, and what they would have been uncompressed.
+	uint64_t bytes_sent() const;
+	uint64_t raw_bytes_sent() const;
+
 private:
-	MPI_Datatype _columnType;
+	// Set up communication with the neighbor in one direction.
+	void add_link(
+		int32_t rank,
+		uint32_t direction,
+		const Region_t &send,
+		const Region_t &recv,
+		MPI_Datatype type);
+
+	// Mark the links completed by a test or wait as arrived.
+	void complete(int32_t count, const int32_t *indices);
+
+	// Encode the cells of a link's send region into its send buffer. Returns the message size.
+	size_t encode(size_t link);
+
+	// Decode a link's receive buffer into its receive region.
+	void decode(size_t link);
+
+	// Copy rows of a link's send region into its contiguous send buffer.
+	void pack(size_t link, size_t y_start, size_t height);
+
+	LifeBoard &_board;
+	MPI_Comm _comm;
+	bool _compress;
 	MPI_Datatype _rowType;
+	MPI_Datatype _cornerType;
 	MPI_Request _send_requests[8];
 	MPI_Request _recv_requests[8];
 	MPI_Status _statuses[8]; 
+	int32_t _ranks[8];       // Neighbor of each link
+	uint32_t _directions[8]; // Direction of each link
+	Region_t _send_regions[8];
+	Region_t _recv_regions[8];
+	std::vector<uint8_t> _send_buffers[8];
+	std::vector<uint8_t> _recv_buffers[8];
+	std::vector<uint8_t> _sent[8]; // Cells of the last message on each link
+	bool _has_sent[8];
+	bool _packed[8];         // Sent and received through contiguous buffers
+	size_t _mirrored[8];     // Rows of the send buffer refreshed since begin
+	uint32_t _present;       // Directions that have a neighbor
+	uint32_t _arrived;       // Directions received since begin
+	uint64_t _bytes_sent;
+	uint64_t _raw_bytes_sent;
 	size_t _links;
 };
 
@@ -0,0 +1,282 @@
+/*
+ *       File:           Batch.cpp
+ *       Description:    Implementation of the batch mode
+ *
+ */
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Batch.h"
+
+// Message tags used between the dispatcher and the group leaders.
+enum BatchTag_t
+{
+	TAG_REQUEST = 1, // Leader -> dispatcher: report the last board, ask for another
+	TAG_ASSIGN  = 2  // Dispatcher -> leader: index of the next board, or -1 when done
+};
+
+// One board listed in the manifest.
+struct BatchJob_t
+{
+	std::string input;
+	std::string output;
+};
+
+// Outcome of one board, as reported by its group leader.
+struct BatchResult_t
+{
+	unsigned long long job;        // Manifest index plus one (0 for no board)
+	unsigned long long status;     // Status_t of the run
+	unsigned long long width;
+	unsigned long long height;
+	unsigned long long generations;
+	unsigned long long population; // Live cells after the last generation
+	unsigned long long micros;     // Wall time of read, simulate and write
+	unsigned long long leader;     // World rank of the group leader
+};
+
+// Number of MPI_UNSIGNED_LONG_LONG values in a BatchResult_t.
+#define RESULT_COUNT (sizeof(BatchResult_t) / sizeof(unsigned long long))
+
+// Read the manifest on processor 0 and broadcast it. Returns true on success.
+static bool read_manifest(const char *path, std::vector<BatchJob_t> &jobs)
+{
+	int32_t rank;
+	std::string text;
+	unsigned long long length = 0;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+	if(rank == 0)
+	{
+		std::ifstream in(path);
+		if(in.good())
+		{
+			std::stringstream ss;
+			ss << in.rdbuf();
+			text = ss.str();
+			length = text.size() + 1;
+		}
+	}
+
+	MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+	if(length == 0)
+		return false;
+
+	text.resize(length);
+	MPI_Bcast(&text[0], length, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+	std::istringstream lines(text.c_str());
+	std::string line;
+	while(std::getline(lines, line))
+	{
+		BatchJob_t job;
+		std::istringstream fields(line);
+		if(!(fields >> job.input) || job.input[0] == '#')
+			continue;
+		if(!(fields >> job.output))
+			return false;
+		jobs.push_back(job);
+	}
+
+	return true;
+}
+
+// Read, simulate and write one board on a group of processors.
+static BatchResult_t run_job(
+	size_t index,
+	const BatchJob_t &job,
+	const LifeOptions_t &options,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t world_rank;
+	LifeBoard board;
+	LifeHeader_t header;
+	BatchResult_t result = {index + 1, STATUS_SUCCESS, 0, 0, 0, 0, 0, 0};
+	double start = MPI_Wtime();
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+	result.leader = world_rank;
+
+	// Only the group's root processor touches the files
+	std::ifstream in;
+	if(rank == 0)
+		in.open(job.input.c_str());
+
+	size_t margin = options.depth ? options.depth : 1;
+	if(!scatter_board(in, board, header, margin, comm))
+	{
+		result.status = STATUS_READ_ERROR;
+		return result;
+	}
+	in.close();
+
+	simulate(board, header, margin, header.generations, options, comm);
+	result.population = population(board, margin, comm);
+
+	std::ofstream out;
+	if(rank == 0)
+		out.open(job.output.c_str());
+	if(!gather_board(out, board, header, margin, comm))
+		result.status = STATUS_WRITE_ERROR;
+	out.close();
+
+	result.width = header.width;
+	result.height = header.height;
+	result.generations = header.generations;
+	result.micros = (MPI_Wtime() - start) * 1e6;
+	return result;
+}
+
+// Hand out boards to group leaders until none are left.
+static void dispatch(
+	const std::vector<BatchJob_t> &jobs,
+	size_t groups,
+	std::vector<BatchResult_t> &results)
+{
+	size_t next = 0;
+	size_t active = groups;
+
+	while(active > 0)
+	{
+		BatchResult_t report;
+		MPI_Status status;
+		MPI_Recv(
+			&report,
+			RESULT_COUNT,
+			MPI_UNSIGNED_LONG_LONG,
+			MPI_ANY_SOURCE,
+			TAG_REQUEST,
+			MPI_COMM_WORLD,
+			&status);
+
+		if(report.job != 0)
+			results[report.job - 1] = report;
+
+		long long assign = -1;
+		if(next < jobs.size())
+			assign = next++;
+		else
+			active--;
+
+		MPI_Send(&assign, 1, MPI_LONG_LONG, status.MPI_SOURCE, TAG_ASSIGN, MPI_COMM_WORLD);
+	}
+}
+
+// Request and run boards on a group until the dispatcher runs out.
+static void work(
+	const std::vector<BatchJob_t> &jobs,
+	const LifeOptions_t &options,
+	MPI_Comm group)
+{
+	int32_t rank;
+	BatchResult_t report = {0, 0, 0, 0, 0, 0, 0, 0};
+
+	MPI_Comm_rank(group, &rank);
+
+	while(true)
+	{
+		long long assign;
+		if(rank == 0)
+		{
+			MPI_Send(&report, RESULT_COUNT, MPI_UNSIGNED_LONG_LONG, 0, TAG_REQUEST, MPI_COMM_WORLD);
+			MPI_Recv(&assign, 1, MPI_LONG_LONG, 0, TAG_ASSIGN, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		}
+
+		MPI_Bcast(&assign, 1, MPI_LONG_LONG, 0, group);
+		if(assign < 0)
+			break;
+
+		report = run_job(assign, jobs[assign], options, group);
+	}
+}
+
+// Write one line per board followed by totals. Returns true on success.
+static bool write_summary(
+	const char *path,
+	const std::vector<BatchJob_t> &jobs,
+	const std::vector<BatchResult_t> &results,
+	double seconds)
+{
+	std::ofstream out(path);
+	size_t failures = 0;
+	unsigned long long cells = 0;
+
+	out << "# input output status width height generations population seconds leader" << std::endl;
+	for(size_t i = 0; i < jobs.size(); i++)
+	{
+		const BatchResult_t &result = results[i];
+		out << jobs[i].input << " " << jobs[i].output << " "
+			<< result.status << " "
+			<< result.width << " "
+			<< result.height << " "
+			<< result.generations << " "
+			<< result.population << " "
+			<< (result.micros / 1e6) << " "
+			<< result.leader << std::endl;
+
+		if(result.status != STATUS_SUCCESS)
+			failures++;
+		cells += result.width * result.height * result.generations;
+	}
+
+	out << "# boards " << jobs.size()
+		<< " failed " << failures
+		<< " seconds " << seconds
+		<< " cell-updates/s " << (seconds > 0 ? cells / seconds : 0) << std::endl;
+
+	return out.good();
+}
+
+Status_t run_batch(
+	const char *manifest_path,
+	const char *summary_path,
+	const LifeOptions_t &options)
+{
+	int32_t rank;
+	int32_t size;
+	std::vector<BatchJob_t> jobs;
+	double start = MPI_Wtime();
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+	if(!read_manifest(manifest_path, jobs))
+		return STATUS_READ_ERROR;
+
+	std::vector<BatchResult_t> results(jobs.size());
+	if(size == 1)
+	{
+		for(size_t i = 0; i < jobs.size(); i++)
+			results[i] = run_job(i, jobs[i], options, MPI_COMM_WORLD);
+	}
+	else
+	{
+		// Processor 0 dispatches; the rest form groups of consecutive ranks
+		size_t workers = size - 1;
+		size_t groups = (workers + options.group_size - 1) / options.group_size;
+		int color = (rank == 0) ? MPI_UNDEFINED : (rank - 1) / options.group_size;
+
+		MPI_Comm group;
+		MPI_Comm_split(MPI_COMM_WORLD, color, rank, &group);
+
+		if(rank == 0)
+		{
+			dispatch(jobs, groups, results);
+		}
+		else
+		{
+			work(jobs, options, group);
+			MPI_Comm_free(&group);
+		}
+	}
+
+	if(rank == 0 && !write_summary(summary_path, jobs, results, MPI_Wtime() - start))
+		return STATUS_WRITE_ERROR;
+
+	return STATUS_SUCCESS;
+}
@@ -0,0 +1,21 @@
+#ifndef BATCH_H
+#define BATCH_H
+/*
+ *       File:           Batch.h
+ *       Description:    Running many independent boards in one MPI job
+ *
+ */
+#include "Parallel.h"
+
+// Run every board in a manifest and write a summary line per board.
+//
+// Each manifest line names an input and an output file; blank lines and lines
+// starting with '#' are skipped. Processor 0 hands boards out on request to
+// groups of options.group_size processors, so a group that finishes early
+// picks up the next board. With a single processor it runs every board itself.
+Status_t run_batch(
+	const char *manifest_path,
+	const char *summary_path,
+	const LifeOptions_t &options);
+
+#endif // BATCH_H
@@ -0,0 +1,247 @@
+/*
+ *       File:           Delta.cpp
+ *       Description:    Implementation of the delta log encoding and reader
+ *
+ */
+#include <cstring>
+
+#include "Delta.h"
+
+// Append a little endian value of the given number of bytes.
+static void append_le(std::vector<uint8_t> &out, uint64_t value, size_t bytes)
+{
+	for(size_t i = 0; i < bytes; i++)
+	{
+		out.push_back(value >> (8 * i));
+	}
+}
+
+// Decode a little endian value of the given number of bytes.
+static uint64_t decode_le(const uint8_t *data, size_t bytes)
+{
+	uint64_t value = 0;
+	for(size_t i = 0; i < bytes; i++)
+	{
+		value |= (uint64_t)data[i] << (8 * i);
+	}
+	return value;
+}
+
+void encode_delta_header(uint64_t width, uint64_t height, std::vector<uint8_t> &out)
+{
+	out.insert(out.end(), DELTA_MAGIC, DELTA_MAGIC + 8);
+	append_le(out, width, 8);
+	append_le(out, height, 8);
+}
+
+void append_varint(std::vector<uint8_t> &out, uint64_t value)
+{
+	while(value >= 0x80)
+	{
+		out.push_back((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(value);
+}
+
+bool read_varint(const uint8_t *&data, const uint8_t *end, uint64_t &value)
+{
+	value = 0;
+	for(size_t shift = 0; shift < 64; shift += 7)
+	{
+		if(data == end)
+			return false;
+		uint8_t byte = *data++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+size_t encode_deltas(
+	const LifeBoard &before,
+	const LifeBoard &after,
+	const Region_t &region,
+	size_t x_offset,
+	size_t y_offset,
+	std::vector<uint8_t> &out)
+{
+	std::vector<uint8_t> rows;
+	std::vector<size_t> cells;
+	size_t row_count = 0;
+	size_t total = 0;
+	size_t last_y = 0;
+
+	for(size_t y = region.y_start; y < (region.y_start + region.height); y++)
+	{
+		const bool *old_row = before[y] + region.x_start;
+		const bool *new_row = after[y] + region.x_start;
+
+		// Most rows are unchanged on a settled board
+		if(memcmp(old_row, new_row, region.width * sizeof(bool)) == 0)
+			continue;
+
+		cells.clear();
+		for(size_t x = 0; x < region.width; x++)
+		{
+			if(old_row[x] != new_row[x])
+				cells.push_back(x);
+		}
+
+		size_t global_y = y - region.y_start + y_offset;
+		append_varint(rows, row_count ? (global_y - last_y - 1) : global_y);
+		append_varint(rows, cells.size());
+		for(size_t i = 0; i < cells.size(); i++)
+		{
+			append_varint(rows, i ? (cells[i] - cells[i - 1] - 1) : (cells[i] + x_offset));
+		}
+
+		last_y = global_y;
+		row_count++;
+		total += cells.size();
+	}
+
+	if(row_count > 0)
+	{
+		append_varint(out, row_count);
+		out.insert(out.end(), rows.begin(), rows.end());
+	}
+
+	return total;
+}
+
+bool apply_deltas(const uint8_t *data, size_t length, LifeBoard &board)
+{
+	const uint8_t *end = data + length;
+
+	while(data != end)
+	{
+		uint64_t row_count;
+		if(!read_varint(data, end, row_count))
+			return false;
+
+		uint64_t y = 0;
+		for(uint64_t r = 0; r < row_count; r++)
+		{
+			uint64_t step;
+			uint64_t cell_count;
+			if(!read_varint(data, end, step) || !read_varint(data, end, cell_count))
+				return false;
+			y = r ? (y + step + 1) : step;
+			if(y >= board.height())
+				return false;
+
+			uint64_t x = 0;
+			bool *row = board[y];
+			for(uint64_t c = 0; c < cell_count; c++)
+			{
+				if(!read_varint(data, end, step))
+					return false;
+				x = c ? (x + step + 1) : step;
+				if(x >= board.width())
+					return false;
+				row[x] = !row[x];
+			}
+		}
+	}
+
+	return true;
+}
+
+DeltaReader::DeltaReader(std::istream &in) :
+	_in(in),
+	_valid(false),
+	_width(0),
+	_height(0),
+	_generation(0)
+{
+	uint8_t header[DELTA_HEADER_SIZE];
+	if(!_in.read(reinterpret_cast<char *>(header), sizeof(header)))
+		return;
+	if(memcmp(header, DELTA_MAGIC, 8) != 0)
+		return;
+
+	_width = decode_le(header + 8, 8);
+	_height = decode_le(header + 16, 8);
+	_valid = true;
+}
+
+bool DeltaReader::valid() const
+{
+	return _valid;
+}
+
+uint64_t DeltaReader::width() const
+{
+	return _width;
+}
+
+uint64_t DeltaReader::height() const
+{
+	return _height;
+}
+
+size_t DeltaReader::generation() const
+{
+	return _generation;
+}
+
+bool DeltaReader::next(LifeBoard &board)
+{
+	uint64_t length;
+	if(!read_length(length))
+		return false;
+
+	_payload.resize(length);
+	if(length > 0 && !_in.read(reinterpret_cast<char *>(&_payload[0]), length))
+	{
+		_valid = false;
+		return false;
+	}
+
+	if(!apply_deltas(length ? &_payload[0] : NULL, length, board))
+	{
+		_valid = false;
+		return false;
+	}
+
+	_generation++;
+	return true;
+}
+
+bool DeltaReader::read_length(uint64_t &length)
+{
+	uint8_t record[DELTA_RECORD_SIZE];
+
+	if(!_valid)
+		return false;
+	if(!_in.read(reinterpret_cast<char *>(record), sizeof(record)))
+		return false;
+
+	length = decode_le(record, sizeof(record));
+	return true;
+}
+
+bool replay_generation(
+	std::istream &base,
+	std::istream &deltas,
+	size_t generation,
+	LifeBoard &board,
+	LifeHeader_t &header)
+{
+	if(!readFile(base, board, header))
+		return false;
+
+	DeltaReader reader(deltas);
+	if(!reader.valid() || reader.width() != board.width() || reader.height() != board.height())
+		return false;
+
+	while(reader.generation() < generation)
+	{
+		if(!reader.next(board))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,99 @@
+#ifndef DELTA_H
+#define DELTA_H
+/*
+ *       File:           Delta.h
+ *       Description:    Encoding and replay of per generation cell changes
+ *
+ */
+#include <istream>
+#include <vector>
+#include <stdint.h>
+#include "LifeUtil.h"
+
+// A delta log starts with DELTA_MAGIC and the board width and height as
+// little endian 64-bit values. One record per generation follows: a little
+// endian 64-bit payload length and then the payload, which is a sequence of
+// chunks listing cells that flipped (were born or died) in that generation.
+// Chunks may come in any order, so each processor can write its own.
+//
+// A chunk is a varint row count followed by each row: the row's y (absolute
+// for the first row of the chunk, otherwise the gap since the previous row),
+// a varint cell count, and each cell's x (absolute for the first cell of the
+// row, otherwise the gap since the previous cell).
+#define DELTA_MAGIC "LIFEDLT2"
+
+// Size in bytes of the delta log header.
+#define DELTA_HEADER_SIZE 24
+
+// Size in bytes of the length that starts each generation record.
+#define DELTA_RECORD_SIZE 8
+
+// Append the delta log header for a board.
+void encode_delta_header(uint64_t width, uint64_t height, std::vector<uint8_t> &out);
+
+// Append an unsigned LEB128 varint.
+void append_varint(std::vector<uint8_t> &out, uint64_t value);
+
+// Read an unsigned LEB128 varint, advancing data. Returns false if truncated.
+bool read_varint(const uint8_t *&data, const uint8_t *end, uint64_t &value);
+
+// Append a chunk listing the cells of region that differ between before and
+// after; coordinates are written offset by (x_offset, y_offset). Nothing is
+// appended if no cell changed. Returns the number of changed cells.
+size_t encode_deltas(
+	const LifeBoard &before,
+	const LifeBoard &after,
+	const Region_t &region,
+	size_t x_offset,
+	size_t y_offset,
+	std::vector<uint8_t> &out);
+
+// Flip every cell listed in a generation's payload. Returns false if the
+// payload is malformed or lists a cell outside of the board.
+bool apply_deltas(const uint8_t *data, size_t length, LifeBoard &board);
+
+// Reads a delta log one generation at a time.
+class DeltaReader
+{
+public:
+	// Read the log header from a binary stream. Check valid() before use.
+	DeltaReader(std::istream &in);
+
+	// Return true if the header was read and the last record was well formed.
+	bool valid() const;
+
+	// Return the board width recorded in the header.
+	uint64_t width() const;
+
+	// Return the board height recorded in the header.
+	uint64_t height() const;
+
+	// Return the generation of the board after the records read so far.
+	size_t generation() const;
+
+	// Advance the board by one recorded generation. Returns false at the end
+	// of the log or if the record is malformed.
+	bool next(LifeBoard &board);
+
+private:
+	// Read the length of the next record. Returns false at the end of the log.
+	bool read_length(uint64_t &length);
+
+	std::istream &_in;
+	bool _valid;
+	uint64_t _width;
+	uint64_t _height;
+	size_t _generation;
+	std::vector<uint8_t> _payload;
+};
+
+// Reconstruct a generation from a base board (in the life file format) and
+// the delta log written from it. Returns true on success.
+bool replay_generation(
+	std::istream &base,
+	std::istream &deltas,
+	size_t generation,
+	LifeBoard &board,
+	LifeHeader_t &header);
+
+#endif // DELTA_H
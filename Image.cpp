@@ -0,0 +1,270 @@
+/*
+ *       File:           Image.cpp
+ *       Description:    Implementation of image frame output
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "Image.h"
+
+// Target number of pixels in a band assembled on the root.
+#define BAND_PIXELS (1 << 20)
+
+// Size of the compressed data carried by one IDAT chunk.
+#define IDAT_SIZE (1 << 16)
+
+// Store a 32-bit value in network byte order.
+static void put_u32(uint8_t *out, uint32_t value)
+{
+	out[0] = value >> 24;
+	out[1] = value >> 16;
+	out[2] = value >> 8;
+	out[3] = value;
+}
+
+PngWriter::PngWriter(std::ostream &out, size_t width, size_t height) :
+	_out(out),
+	_width(width),
+	_row(width + 1),
+	_idat(IDAT_SIZE)
+{
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	_out.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+	// Width, height, 8 bits, grayscale, deflate, adaptive filtering, no interlace
+	uint8_t ihdr[13];
+	put_u32(ihdr, width);
+	put_u32(ihdr + 4, height);
+	ihdr[8] = 8;
+	ihdr[9] = 0;
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+	write_chunk("IHDR", ihdr, sizeof(ihdr));
+
+	memset(&_stream, 0, sizeof(_stream));
+	deflateInit(&_stream, Z_DEFAULT_COMPRESSION);
+	_stream.next_out = &_idat[0];
+	_stream.avail_out = _idat.size();
+}
+
+PngWriter::~PngWriter()
+{
+	deflateEnd(&_stream);
+}
+
+bool PngWriter::write_rows(const uint8_t *pixels, size_t rows)
+{
+	for(size_t y = 0; y < rows; y++)
+	{
+		// Each row starts with its filter type; 0 leaves it unfiltered
+		_row[0] = 0;
+		memcpy(&_row[1], pixels + (y * _width), _width);
+
+		_stream.next_in = &_row[0];
+		_stream.avail_in = _row.size();
+		while(_stream.avail_in > 0)
+		{
+			if(deflate(&_stream, Z_NO_FLUSH) == Z_STREAM_ERROR)
+				return false;
+			if(_stream.avail_out == 0)
+				flush_idat();
+		}
+	}
+
+	return _out.good();
+}
+
+bool PngWriter::finish()
+{
+	int status;
+	do
+	{
+		status = deflate(&_stream, Z_FINISH);
+		if(status == Z_STREAM_ERROR)
+			return false;
+		flush_idat();
+	} while(status != Z_STREAM_END);
+
+	write_chunk("IEND", NULL, 0);
+	return _out.good();
+}
+
+void PngWriter::write_chunk(const char *type, const uint8_t *data, size_t length)
+{
+	uint8_t header[8];
+	uint8_t trailer[4];
+
+	put_u32(header, length);
+	memcpy(header + 4, type, 4);
+
+	uLong crc = crc32(0, header + 4, 4);
+	if(length > 0)
+		crc = crc32(crc, data, length);
+	put_u32(trailer, crc);
+
+	_out.write(reinterpret_cast<const char *>(header), sizeof(header));
+	if(length > 0)
+		_out.write(reinterpret_cast<const char *>(data), length);
+	_out.write(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+}
+
+void PngWriter::flush_idat()
+{
+	size_t length = _idat.size() - _stream.avail_out;
+	if(length > 0)
+		write_chunk("IDAT", &_idat[0], length);
+
+	_stream.next_out = &_idat[0];
+	_stream.avail_out = _idat.size();
+}
+
+// Return the header of a binary PGM image.
+static std::string pgm_header(size_t width, size_t height)
+{
+	std::stringstream ss;
+	ss << "P5\n" << width << " " << height << "\n255\n";
+	return ss.str();
+}
+
+// Write a full-resolution PGM with every processor writing its own subgrid.
+static bool write_pgm_collective(
+	const std::string &path,
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+	MPI_File file;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	std::pair<size_t, size_t> board_size = std::make_pair(header.width, header.height);
+	std::pair<size_t, size_t> topology = calculate_topology(size, board_size);
+	Region_t mine = subgrid_region(rank, topology, board_size);
+	std::string text = pgm_header(header.width, header.height);
+
+	if(MPI_File_open(comm, const_cast<char *>(path.c_str()),
+		MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+		return false;
+	MPI_File_set_size(file, 0);
+
+	if(rank == 0)
+	{
+		MPI_File_write_at(file, 0, const_cast<char *>(text.data()), text.size(),
+			MPI_CHAR, MPI_STATUS_IGNORE);
+	}
+
+	// Each processor's rows land at their place in the image. The offsets are
+	// 64-bit and counts are of whole rows, so no count exceeds an int
+	MPI_Offset start = text.size() + ((MPI_Offset)mine.y_start * header.width) + mine.x_start;
+	MPI_Datatype filetype;
+	MPI_Datatype rowtype;
+	MPI_Type_create_hvector(mine.height, mine.width, (MPI_Aint)header.width, MPI_BYTE, &filetype);
+	MPI_Type_commit(&filetype);
+	MPI_Type_contiguous(mine.width, MPI_BYTE, &rowtype);
+	MPI_Type_commit(&rowtype);
+	MPI_File_set_view(file, start, MPI_BYTE, filetype, const_cast<char *>("native"), MPI_INFO_NULL);
+
+	std::vector<uint8_t> pixels(mine.width * mine.height);
+	for(size_t y = 0; y < mine.height; y++)
+	{
+		const bool *row = local_board[margin + y] + margin;
+		for(size_t x = 0; x < mine.width; x++)
+		{
+			pixels[(y * mine.width) + x] = row[x] ? 255 : 0;
+		}
+	}
+
+	int32_t result = MPI_File_write_all(file, pixels.empty() ? NULL : &pixels[0],
+		mine.height, rowtype, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+
+	MPI_Type_free(&rowtype);
+	MPI_Type_free(&filetype);
+	MPI_File_close(&file);
+	return result;
+}
+
+bool write_frame(
+	const std::string &path,
+	ImageFormat_t format,
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	size_t block,
+	MPI_Comm comm)
+{
+	int32_t rank;
+
+	MPI_Comm_rank(comm, &rank);
+
+	if(format == IMAGE_PGM && block == 1)
+		return write_pgm_collective(path, local_board, header, margin, comm);
+
+	const size_t width = (header.width + block - 1) / block;
+	const size_t height = (header.height + block - 1) / block;
+	const size_t band_rows = std::max<size_t>(1, BAND_PIXELS / width);
+
+	std::ofstream out;
+	PngWriter *png = NULL;
+	if(rank == 0)
+	{
+		out.open(path.c_str(), std::ios::out | std::ios::binary);
+		if(format == IMAGE_PNG)
+			png = new PngWriter(out, width, height);
+		else
+			out << pgm_header(width, height);
+	}
+
+	// Reduce and write one band of rows at a time
+	bool result = true;
+	std::vector<uint32_t> counts;
+	std::vector<uint8_t> pixels;
+	for(size_t by = 0; by < height; by += band_rows)
+	{
+		size_t rows = std::min(band_rows, height - by);
+		Region_t window = {
+			0,
+			by * block,
+			header.width,
+			std::min<size_t>(rows * block, header.height - (by * block))};
+
+		if(!reduce_window(local_board, header, margin, window, block, counts, comm))
+			continue;
+
+		// Scale each count by the area of its tile (edge tiles may be partial)
+		pixels.resize(rows * width);
+		for(size_t y = 0; y < rows; y++)
+		{
+			size_t tile_height = std::min<size_t>(block, window.height - (y * block));
+			for(size_t x = 0; x < width; x++)
+			{
+				size_t tile_width = std::min<size_t>(block, header.width - (x * block));
+				pixels[(y * width) + x] = (255 * (uint64_t)counts[(y * width) + x]) / (tile_width * tile_height);
+			}
+		}
+
+		if(png != NULL)
+			result = png->write_rows(&pixels[0], rows) && result;
+		else
+			out.write(reinterpret_cast<const char *>(&pixels[0]), pixels.size());
+	}
+
+	if(rank == 0)
+	{
+		if(png != NULL)
+		{
+			result = png->finish() && result;
+			delete png;
+		}
+		result = out.good() && result;
+	}
+
+	return result;
+}
@@ -0,0 +1,58 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+/*
+ *       File:           Image.h
+ *       Description:    Writing the distributed board as grayscale image frames
+ *
+ */
+#include <string>
+#include <ostream>
+#include <zlib.h>
+#include "Parallel.h"
+
+// Stream an 8-bit grayscale PNG, one band of rows at a time.
+class PngWriter
+{
+public:
+	// Write the signature and header for an image of the given size.
+	PngWriter(std::ostream &out, size_t width, size_t height);
+
+	// Dtor.
+	~PngWriter();
+
+	// Compress rows of width pixels each. Returns true on success.
+	bool write_rows(const uint8_t *pixels, size_t rows);
+
+	// Flush the compressed data and write the trailer. Returns true on success.
+	bool finish();
+
+private:
+	// Write one chunk with its length and CRC.
+	void write_chunk(const char *type, const uint8_t *data, size_t length);
+
+	// Emit the compressed output buffer as an IDAT chunk.
+	void flush_idat();
+
+	std::ostream &_out;
+	size_t _width;
+	z_stream _stream;
+	std::vector<uint8_t> _row;
+	std::vector<uint8_t> _idat;
+};
+
+// Write the board as a grayscale image where each pixel is one block x block
+// tile, with brightness proportional to its live cells. Full-resolution PGM
+// is written collectively with MPI-IO, each processor placing its own rows;
+// otherwise the root assembles the image one band of rows at a time, so its
+// memory is bounded by a band rather than the board. Returns true on success
+// (the result is valid on the root).
+bool write_frame(
+	const std::string &path,
+	ImageFormat_t format,
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	size_t block,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+#endif // IMAGE_H
@@ -10,8 +10,14 @@
  */
 #include "LifeUtil.h"
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
 
 bool readFile(std::istream &in, LifeBoard &board, LifeHeader_t &header)
 {
@@ -89,7 +95,7 @@ void dumpBoard(const LifeBoard &board)
 }
 #endif
 
-inline bool is_alive(uint32_t x, uint32_t y, const LifeBoard &generation)
+inline bool is_alive(size_t x, size_t y, const LifeBoard &generation)
 {
 	if(x >= generation.width()) return false;
 	if(y >= generation.height()) return false;
@@ -139,49 +145,937 @@ void step_region(
 
 }
 
-std::pair<size_t, size_t> calculate_topology(
-	int32_t comm_size,
-	const std::pair<size_t, size_t>& board_size)
+// Lookup table for step_region_lut. Bit (4 * c) + r of an index is the cell
+// in column c and row r of a 4x4 neighborhood. Bits 0-3 of an entry are the
+// next states of the inner cells (1,1), (2,1), (1,2) and (2,2).
+struct LifeTable_t
 {
-	size_t x;
-	size_t y;
-	size_t min_dist;
+	uint8_t entries[1 << 16];
 
-	if(comm_size == 0)
+	LifeTable_t()
 	{
-		x = 0;
-		y = 0;
+		for(uint32_t index = 0; index < (1 << 16); index++)
+		{
+			uint8_t result = 0;
+			for(uint32_t bit = 0; bit < 4; bit++)
+			{
+				uint32_t cx = 1 + (bit & 1);
+				uint32_t cy = 1 + (bit >> 1);
+				uint32_t alive_sum = 0;
+
+				for(uint32_t y = cy - 1; y <= cy + 1; y++)
+				{
+					for(uint32_t x = cx - 1; x <= cx + 1; x++)
+					{
+						if(x != cx || y != cy)
+							alive_sum += (index >> ((4 * x) + y)) & 1;
+					}
+				}
+
+				bool alive = (index >> ((4 * cx) + cy)) & 1;
+				if((alive_sum == 3) || (alive && alive_sum == 2))
+					result |= (1 << bit);
+			}
+			entries[index] = result;
+		}
 	}
-	else if(comm_size == 1)
+};
+
+// Return the shared lookup table, building it on first use.
+static const uint8_t *life_table()
+{
+	static const LifeTable_t table;
+	return table.entries;
+}
+
+// Return the 4 cells of a column of a neighborhood as a 4-bit value.
+inline uint32_t column_bits(const uint8_t * const rows[4], size_t x)
+{
+	return rows[0][x] | (rows[1][x] << 1) | (rows[2][x] << 2) | (rows[3][x] << 3);
+}
+
+// As column_bits, but columns outside of the board are dead.
+inline uint32_t checked_column_bits(const uint8_t * const rows[4], size_t x, size_t width)
+{
+	return (x < width) ? column_bits(rows, x) : 0;
+}
+
+void step_region_lut(
+	const Region_t &region,
+	const LifeBoard &src_generation,
+	LifeBoard &dst_generation)
+{
+	const uint8_t *table = life_table();
+	const size_t width = src_generation.width();
+	const size_t height = src_generation.height();
+	const size_t x_end = region.x_start + region.width;
+	const size_t y_end = region.y_start + region.height;
+	std::vector<uint8_t> dead(width, 0);
+
+	size_t y = region.y_start;
+	for(; y + 1 < y_end; y += 2)
 	{
-		x = 1;
-		y = 1;
+		// Rows outside of the board read from a dead row
+		const uint8_t *rows[4];
+		for(size_t r = 0; r < 4; r++)
+		{
+			size_t row = y + r - 1;
+			rows[r] = (row < height) ?
+				reinterpret_cast<const uint8_t *>(src_generation[row]) :
+				&dead[0];
+		}
+
+		bool *out0 = dst_generation[y];
+		bool *out1 = dst_generation[y + 1];
+		size_t x = region.x_start;
+
+		// The window holds columns x - 1 to x + 2; it slides two columns per lookup
+		uint32_t window =
+			checked_column_bits(rows, x - 1, width) |
+			(checked_column_bits(rows, x, width) << 4);
+
+		for(; (x + 1 < x_end) && (x + 2 < width); x += 2)
+		{
+			window |= (column_bits(rows, x + 1) << 8) | (column_bits(rows, x + 2) << 12);
+			uint8_t next = table[window];
+			out0[x] = next & 1;
+			out0[x + 1] = (next >> 1) & 1;
+			out1[x] = (next >> 2) & 1;
+			out1[x + 1] = (next >> 3) & 1;
+			window >>= 8;
+		}
+
+		for(; x + 1 < x_end; x += 2)
+		{
+			window |=
+				(checked_column_bits(rows, x + 1, width) << 8) |
+				(checked_column_bits(rows, x + 2, width) << 12);
+			uint8_t next = table[window];
+			out0[x] = next & 1;
+			out0[x + 1] = (next >> 1) & 1;
+			out1[x] = (next >> 2) & 1;
+			out1[x + 1] = (next >> 3) & 1;
+			window >>= 8;
+		}
+
+		// Odd column left over
+		if(x < x_end)
+		{
+			Region_t column = {x, y, 1, 2};
+			step_region(column, src_generation, dst_generation);
+		}
 	}
-	else
+
+	// Odd row left over
+	if(y < y_end)
+	{
+		Region_t row = {region.x_start, y, region.width, 1};
+		step_region(row, src_generation, dst_generation);
+	}
+}
+
+void step_region_temporal(
+	const Region_t &region,
+	const Region_t &domain,
+	const LifeBoard &src_generation,
+	LifeBoard &dst_generation,
+	size_t generations,
+	size_t tile_size,
+	LifeBoard scratch[2],
+	StepKernel_t kernel)
+{
+	assert(generations > 0);
+	assert(tile_size > 0);
+
+	const size_t margin = generations;
+	const size_t span = tile_size + (2 * margin);
+	const size_t domain_x_end = domain.x_start + domain.width;
+	const size_t domain_y_end = domain.y_start + domain.height;
+	const size_t region_x_end = region.x_start + region.width;
+	const size_t region_y_end = region.y_start + region.height;
+
+	// Tile-local generations; board coordinate (x, y) maps to buffer
+	// coordinate (x + margin - tile.x_start, y + margin - tile.y_start).
+	// Only the copied cells are read, so larger buffers serve as they are.
+	for(size_t i = 0; i < 2; i++)
 	{
-		min_dist = comm_size;
-		for(size_t i = 1; i < (comm_size / 2) + 1; i++)
+		if(scratch[i].width() < span || scratch[i].height() < span)
+			scratch[i].resize(span, span);
+	}
+
+	for(size_t ty = region.y_start; ty < region_y_end; ty += tile_size)
+	{
+		for(size_t tx = region.x_start; tx < region_x_end; tx += tile_size)
 		{
-			size_t t = comm_size / i;
-			if((t * i) != comm_size)
-			continue;
+			Region_t tile = {
+				tx,
+				ty,
+				std::min(tile_size, region_x_end - tx),
+				std::min(tile_size, region_y_end - ty)};
+
+			// Grow the tile by the margin, clipped to the domain
+			size_t x0 = std::max(tile.x_start, domain.x_start + margin) - margin;
+			size_t y0 = std::max(tile.y_start, domain.y_start + margin) - margin;
+			size_t x1 = std::min(tile.x_start + tile.width + margin, domain_x_end);
+			size_t y1 = std::min(tile.y_start + tile.height + margin, domain_y_end);
+			bool clipped =
+				(x0 + margin != tile.x_start) ||
+				(y0 + margin != tile.y_start) ||
+				(x1 != tile.x_start + tile.width + margin) ||
+				(y1 != tile.y_start + tile.height + margin);
+
+			// Cells outside of the domain must read as dead in both buffers
+			if(clipped)
+			{
+				memset(scratch[0].data(), 0, scratch[0].capacity() * sizeof(bool));
+				memset(scratch[1].data(), 0, scratch[1].capacity() * sizeof(bool));
+			}
 
-			size_t dist = abs(t - i);
-			if(dist < min_dist)
+			size_t bx0 = x0 + margin - tile.x_start;
+			size_t by0 = y0 + margin - tile.y_start;
+			size_t bx1 = x1 + margin - tile.x_start;
+			size_t by1 = y1 + margin - tile.y_start;
+			for(size_t y = y0; y < y1; y++)
 			{
-				min_dist = dist;
-				x = t;
-				y = i;
+				memcpy(
+					&scratch[0][y + margin - tile.y_start][bx0],
+					&src_generation[y][x0],
+					(x1 - x0) * sizeof(bool));
 			}
+
+			// Each generation shrinks the valid area by one cell per side
+			bool index = false;
+			for(size_t g = 1; g <= generations; g++)
+			{
+				size_t rx0 = std::max(g, bx0);
+				size_t ry0 = std::max(g, by0);
+				size_t rx1 = std::min(bx1, margin + tile.width + (margin - g));
+				size_t ry1 = std::min(by1, margin + tile.height + (margin - g));
+
+				Region_t step = {rx0, ry0, rx1 - rx0, ry1 - ry0};
+				kernel(step, scratch[index], scratch[!index]);
+				index = !index;
+			}
+
+			for(size_t y = 0; y < tile.height; y++)
+			{
+				memcpy(
+					&dst_generation[tile.y_start + y][tile.x_start],
+					&scratch[index][margin + y][margin],
+					tile.width * sizeof(bool));
+			}
+		}
+	}
+}
+
+// Parse an unsigned integer argument: digits only, so a sign is rejected
+// rather than wrapped, and it must fit. Returns true on success.
+static bool parse_number(const char *text, unsigned long long &value)
+{
+	char *end;
+	errno = 0;
+	value = strtoull(text, &end, 10);
+	return isdigit((unsigned char)*text) && *end == '\0' && errno == 0;
+}
+
+// Parse a positive integer argument. Returns true on success.
+static bool parse_count(const char *text, size_t &value)
+{
+	unsigned long long result;
+	if(!parse_number(text, result) || result == 0 || result > SIZE_MAX)
+		return false;
+
+	value = result;
+	return true;
+}
+
+// Parse an argument of count comma separated unsigned integers. Returns true
+// on success.
+static bool parse_numbers(const char *text, unsigned long long *values, size_t count)
+{
+	std::string rest(text);
+	for(size_t v = 0; v < count; v++)
+	{
+		size_t comma = (v + 1 < count) ? rest.find(',') : rest.size();
+		if(comma == std::string::npos || !parse_number(rest.substr(0, comma).c_str(), values[v]))
+			return false;
+		rest.erase(0, comma + 1);
+	}
+
+	return true;
+}
+
+void step_tiled_board(
+	TiledLifeBoard board[2],
+	bool &index,
+	size_t generations,
+	size_t depth,
+	StepKernel_t kernel)
+{
+	const size_t g = board[0].ghost();
+	const size_t tile = board[0].tile_size();
+	const size_t span = board[0].span();
+	depth = std::max<size_t>(1, std::min(depth, g));
+	LifeBoard scratch[2];
+
+	size_t steps;
+	for(size_t i = 0; i < generations; i += steps)
+	{
+		steps = std::min(depth, generations - i);
+		TiledLifeBoard &src = board[index];
+		TiledLifeBoard &dst = board[!index];
+		src.refresh_ghosts();
+
+		for(TiledLifeBoard::tile_iterator it = src.begin(); it != src.end(); ++it)
+		{
+			TiledLifeBoard::Tile_t t = *it;
+			size_t x0 = t.tx * tile;
+			size_t y0 = t.ty * tile;
+			size_t row = t.slot * span;
+
+			// The tile's cells, and the part of its block that is on the board
+			Region_t region = {
+				g,
+				row + g,
+				std::min(tile, src.width() - x0),
+				std::min(tile, src.height() - y0)};
+			size_t dx0 = std::max(x0, g) - g;
+			size_t dy0 = std::max(y0, g) - g;
+			size_t dx1 = std::min(x0 + tile + g, (size_t)src.width());
+			size_t dy1 = std::min(y0 + tile + g, (size_t)src.height());
+			Region_t domain = {
+				dx0 + g - x0,
+				row + dy0 + g - y0,
+				dx1 - dx0,
+				dy1 - dy0};
+
+			step_region_temporal(region, domain, src.storage(), dst.storage(), steps, tile, scratch, kernel);
 		}
+
+		index = !index;
 	}
+}
+
+void query_window(
+	const LifeBoard &board,
+	const Region_t &window,
+	size_t generations,
+	LifeBoard &result,
+	StepKernel_t kernel)
+{
+	// The light cone, clipped to the board; only its clipped sides touch
+	// dead cells beyond the board, so it can be stepped as a board of its own
+	size_t x0 = window.x_start - std::min(window.x_start, generations);
+	size_t y0 = window.y_start - std::min(window.y_start, generations);
+	size_t x1 = std::min(window.x_start + window.width + generations, board.width());
+	size_t y1 = std::min(window.y_start + window.height + generations, board.height());
 
-	if(board_size.first >= board_size.second)
+	LifeBoard cone[2];
+	bool index = false;
+	cone[0].resize(x1 - x0, y1 - y0);
+	cone[1].resize(x1 - x0, y1 - y0);
+	for(size_t y = y0; y < y1; y++)
 	{
-		return std::make_pair(std::max(x, y), std::min(x, y));
+		std::copy(board[y] + x0, board[y] + x1, cone[0][y - y0]);
 	}
-	else
+
+	// Shrink the region stepped by a cell on each side per generation
+	for(size_t g = generations; g > 0; g--)
+	{
+		size_t grow = g - 1;
+		size_t rx0 = window.x_start - std::min(window.x_start, grow);
+		size_t ry0 = window.y_start - std::min(window.y_start, grow);
+		size_t rx1 = std::min(window.x_start + window.width + grow, x1);
+		size_t ry1 = std::min(window.y_start + window.height + grow, y1);
+		Region_t region = {rx0 - x0, ry0 - y0, rx1 - rx0, ry1 - ry0};
+		kernel(region, cone[index], cone[!index]);
+		index = !index;
+	}
+
+	result.resize(window.width, window.height);
+	for(size_t y = 0; y < window.height; y++)
+	{
+		const bool *row = cone[index][window.y_start - y0 + y] + (window.x_start - x0);
+		std::copy(row, row + window.width, result[y]);
+	}
+}
+
+// Finalizer of the splitmix64 generator; a bijection with good avalanche.
+static inline uint64_t mix64(uint64_t value)
+{
+	value ^= value >> 30;
+	value *= 0xbf58476d1ce4e5b9ULL;
+	value ^= value >> 27;
+	value *= 0x94d049bb133111ebULL;
+	value ^= value >> 31;
+	return value;
+}
+
+// Combine two coordinates into one 64-bit key: (high << 32) | low while both
+// fit in 32 bits, so checksums of smaller boards are unchanged, and a hash of
+// both otherwise.
+static inline uint64_t pair_key(uint64_t high, uint64_t low)
+{
+	if(((high | low) >> 32) == 0)
+		return (high << 32) | low;
+	return mix64(high) ^ mix64(mix64(low) + 1);
+}
+
+// A pattern for stamps, with 'O' for live cells.
+struct Pattern_t
+{
+	const char *name;
+	const char *rows[9];
+};
+
+// Patterns known to find_pattern.
+static const Pattern_t patterns[] = {
+	{"glider", {".O.", "..O", "OOO"}},
+	{"blinker", {"OOO"}},
+	{"block", {"OO", "OO"}},
+	{"rpentomino", {".OO", "OO.", ".O."}},
+	{"acorn", {".O.....", "...O...", "OO..OOO"}},
+	{"diehard", {"......O.", "OO......", ".O...OOO"}},
+	{"gosper", {
+		"........................O...........",
+		"......................O.O...........",
+		"............OO......OO............OO",
+		"...........O...O....OO............OO",
+		"OO........O.....O...OO..............",
+		"OO........O...O.OO....O.O...........",
+		"..........O.....O.......O...........",
+		"...........O...O....................",
+		"............OO......................"}}};
+
+int find_pattern(const std::string &name)
+{
+	for(size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
 	{
-		return std::make_pair(std::min(x, y), std::max(x, y));
+		if(name == patterns[p].name)
+			return p;
 	}
+	return -1;
+}
+
+void generate_region(
+	LifeBoard &board,
+	const Region_t &region,
+	size_t x_offset,
+	size_t y_offset,
+	const LifeOptions_t &options)
+{
+	// A cell is alive when its hash is below the threshold. Fills that round
+	// to 2^64 would not convert, so they are clamped.
+	const bool all = options.fill >= 1.0;
+	const double scaled = options.fill * 18446744073709551616.0;
+	uint64_t threshold = 0;
+	if(!all && options.fill > 0.0)
+		threshold = (scaled >= 18446744073709551616.0) ? UINT64_MAX : (uint64_t)scaled;
+	const uint64_t seed = mix64(options.seed);
+
+	for(size_t y = 0; y < region.height; y++)
+	{
+		bool *row = board[region.y_start + y] + region.x_start;
+		for(size_t x = 0; x < region.width; x++)
+		{
+			row[x] = all || (mix64(seed ^ pair_key(y + y_offset, x + x_offset)) < threshold);
+		}
+	}
+
+	// Draw the part of each stamp that falls in the region
+	for(size_t i = 0; i < options.stamps.size(); i++)
+	{
+		const Stamp_t &stamp = options.stamps[i];
+		const Pattern_t &pattern = patterns[stamp.pattern];
+		for(size_t py = 0; py < 9 && pattern.rows[py] != NULL; py++)
+		{
+			size_t y = stamp.y + py;
+			if(y < y_offset || y >= y_offset + region.height)
+				continue;
+
+			bool *row = board[region.y_start + (y - y_offset)] + region.x_start;
+			for(size_t px = 0; pattern.rows[py][px] != '\0'; px++)
+			{
+				size_t x = stamp.x + px;
+				if(x >= x_offset && x < x_offset + region.width)
+					row[x - x_offset] = (pattern.rows[py][px] == 'O');
+			}
+		}
+	}
+}
+
+StepKernel_t find_kernel(const std::string &name)
+{
+	if(name == "basic")
+		return step_region;
+	if(name == "lut")
+		return step_region_lut;
+	return NULL;
+}
+
+const char *kernel_name(StepKernel_t kernel)
+{
+	if(kernel == step_region)
+		return "basic";
+	if(kernel == step_region_lut)
+		return "lut";
+	return NULL;
+}
+
+uint64_t checksum_cell(uint64_t x, uint64_t y)
+{
+	return mix64(pair_key(y, x));
+}
+
+uint64_t checksum_region(
+	const LifeBoard &board,
+	const Region_t &region,
+	size_t x_offset,
+	size_t y_offset)
+{
+	uint64_t sum = 0;
+
+	for(size_t y = 0; y < region.height; y++)
+	{
+		const bool *row = board[region.y_start + y] + region.x_start;
+		for(size_t x = 0; x < region.width; x++)
+		{
+			if(row[x])
+				sum += mix64(pair_key(y + y_offset, x + x_offset));
+		}
+	}
+
+	return sum;
+}
+
+uint64_t finish_checksum(uint64_t sum, uint64_t width, uint64_t height)
+{
+	return mix64(sum ^ mix64(pair_key(width, height)));
+}
+
+void print_checksum(std::ostream &out, size_t generation, uint64_t checksum)
+{
+	std::ios::fmtflags flags = out.flags();
+	char fill = out.fill();
+
+	out << "Generation " << generation << " checksum ";
+	out << std::hex << std::setw(16) << std::setfill('0') << checksum << std::endl;
+
+	out.flags(flags);
+	out.fill(fill);
+}
+
+bool parse_options(int argc, char **argv, LifeOptions_t &options)
+{
+	options.depth = 0;
+	options.tile = 128;
+	options.kernel = step_region;
+	options.batch = false;
+	options.serve = false;
+	options.group_size = 1;
+	options.compress = false;
+	options.unbounded = false;
+	options.plan = false;
+	options.max_idle = 0;
+	options.topology = std::make_pair(0, 0);
+	options.has_window = false;
+	options.density = 1;
+	options.frames.clear();
+	options.frame_interval = 1;
+	options.frame_format = IMAGE_PGM;
+	options.frame_block = 1;
+	options.deltas.clear();
+	options.threads = 1;
+	options.tiled = false;
+	options.tile_order = TILE_HILBERT;
+	options.autotune = false;
+	options.tune_cache = "life.tune";
+	options.checksum = false;
+	options.checksum_interval = 0;
+	options.sparse = false;
+	options.has_query = false;
+	options.query = 0;
+	options.has_replay = false;
+	options.replay = 0;
+	options.pin = false;
+	options.numa = NUMA_DEFAULT;
+	options.generate = false;
+	options.fill = 0.5;
+	options.seed = 0;
+	options.stamps.clear();
+
+	for(int i = 3; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+
+		// Flags without a value
+		if(arg == "--batch")
+		{
+			options.batch = true;
+			continue;
+		}
+		if(arg == "--pin")
+		{
+			options.pin = true;
+			continue;
+		}
+		if(arg == "--serve")
+		{
+			options.serve = true;
+			continue;
+		}
+		if(arg == "--compress")
+		{
+			options.compress = true;
+			continue;
+		}
+		if(arg == "--unbounded")
+		{
+			options.unbounded = true;
+			continue;
+		}
+		if(arg == "--plan")
+		{
+			options.plan = true;
+			continue;
+		}
+		if(arg == "--autotune")
+		{
+			options.autotune = true;
+			continue;
+		}
+		if(arg == "--checksum")
+		{
+			options.checksum = true;
+			continue;
+		}
+		if(arg == "--sparse")
+		{
+			options.sparse = true;
+			continue;
+		}
+
+		if((i + 1) >= argc)
+			return false;
+		const char *value = argv[++i];
+
+		if(arg == "--depth")
+		{
+			if(!parse_count(value, options.depth))
+				return false;
+		}
+		else if(arg == "--tile")
+		{
+			if(!parse_count(value, options.tile))
+				return false;
+		}
+		else if(arg == "--group-size")
+		{
+			if(!parse_count(value, options.group_size))
+				return false;
+		}
+		else if(arg == "--max-idle")
+		{
+			unsigned long long max_idle;
+			if(!parse_number(value, max_idle))
+				return false;
+			options.max_idle = max_idle;
+		}
+		else if(arg == "--topology")
+		{
+			size_t columns;
+			size_t rows;
+			std::string text(value);
+			size_t split = text.find('x');
+			if(split == std::string::npos ||
+				!parse_count(text.substr(0, split).c_str(), columns) ||
+				!parse_count(text.substr(split + 1).c_str(), rows))
+				return false;
+			options.topology = std::make_pair(columns, rows);
+		}
+		else if(arg == "--window")
+		{
+			unsigned long long values[4];
+			if(!parse_numbers(value, values, 4))
+				return false;
+			Region_t window = {values[0], values[1], values[2], values[3]};
+			if(window.width == 0 || window.height == 0)
+				return false;
+			options.window = window;
+			options.has_window = true;
+		}
+		else if(arg == "--density")
+		{
+			if(!parse_count(value, options.density))
+				return false;
+		}
+		else if(arg == "--frames")
+		{
+			options.frames = value;
+			if(options.frames.empty())
+				return false;
+		}
+		else if(arg == "--deltas")
+		{
+			options.deltas = value;
+			if(options.deltas.empty())
+				return false;
+		}
+		else if(arg == "--tune-cache")
+		{
+			options.tune_cache = value;
+			if(options.tune_cache.empty())
+				return false;
+		}
+		else if(arg == "--layout")
+		{
+			std::string layout(value);
+			options.tiled = (layout != "rows");
+			if(layout == "morton")
+				options.tile_order = TILE_MORTON;
+			else if(layout == "hilbert")
+				options.tile_order = TILE_HILBERT;
+			else if(layout != "rows")
+				return false;
+		}
+		else if(arg == "--threads")
+		{
+			unsigned long long threads;
+			if(!parse_number(value, threads))
+				return false;
+			options.threads = threads;
+		}
+		else if(arg == "--numa")
+		{
+			std::string policy(value);
+			if(policy == "first-touch")
+				options.numa = NUMA_FIRST_TOUCH;
+			else if(policy == "interleave")
+				options.numa = NUMA_INTERLEAVE;
+			else
+				return false;
+		}
+		else if(arg == "--generate")
+		{
+			unsigned long long values[3];
+			if(!parse_numbers(value, values, 3))
+				return false;
+			if(values[0] == 0 || values[1] == 0)
+				return false;
+			options.generated.height = values[0];
+			options.generated.width = values[1];
+			options.generated.generations = values[2];
+			options.generate = true;
+		}
+		else if(arg == "--fill")
+		{
+			char *end;
+			options.fill = strtod(value, &end);
+			if(*value == '\0' || *end != '\0' || !(options.fill >= 0.0 && options.fill <= 1.0))
+				return false;
+		}
+		else if(arg == "--seed")
+		{
+			unsigned long long seed;
+			if(!parse_number(value, seed))
+				return false;
+			options.seed = seed;
+		}
+		else if(arg == "--stamp")
+		{
+			std::string text(value);
+			size_t first = text.find(',');
+			if(first == std::string::npos)
+				return false;
+
+			int pattern = find_pattern(text.substr(0, first));
+			unsigned long long position[2];
+			if(pattern < 0 || !parse_numbers(text.c_str() + first + 1, position, 2))
+				return false;
+			Stamp_t stamp;
+			stamp.x = position[0];
+			stamp.y = position[1];
+			stamp.pattern = pattern;
+			options.stamps.push_back(stamp);
+		}
+		else if(arg == "--query")
+		{
+			unsigned long long query;
+			if(!parse_number(value, query))
+				return false;
+			options.query = query;
+			options.has_query = true;
+		}
+		else if(arg == "--replay")
+		{
+			unsigned long long replay;
+			if(!parse_number(value, replay))
+				return false;
+			options.replay = replay;
+			options.has_replay = true;
+		}
+		else if(arg == "--checksum-interval")
+		{
+			if(!parse_count(value, options.checksum_interval))
+				return false;
+			options.checksum = true;
+		}
+		else if(arg == "--frame-interval")
+		{
+			if(!parse_count(value, options.frame_interval))
+				return false;
+		}
+		else if(arg == "--frame-block")
+		{
+			if(!parse_count(value, options.frame_block))
+				return false;
+		}
+		else if(arg == "--frame-format")
+		{
+			std::string format(value);
+			if(format == "pgm")
+				options.frame_format = IMAGE_PGM;
+			else if(format == "png")
+				options.frame_format = IMAGE_PNG;
+			else
+				return false;
+		}
+		else if(arg == "--kernel")
+		{
+			options.kernel = find_kernel(value);
+			if(options.kernel == NULL)
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// The cost model used by calculate_topology until set_topology_model is called.
+static TopologyModel_t g_topology_model = {
+	5e-6,  // latency
+	1e-10, // byte_time
+	1e-6,  // local_latency
+	5e-11, // local_byte_time
+	2e-9,  // cell_time
+	1      // ranks_per_node
+};
+
+// A configuration that calculate_topology returns when it fits, or 0x0.
+static std::pair<size_t, size_t> g_topology_override = std::make_pair(0, 0);
+
+void set_topology_override(const std::pair<size_t, size_t> &topology)
+{
+	g_topology_override = topology;
+}
+
+void set_topology_model(const TopologyModel_t &model)
+{
+	g_topology_model = model;
+}
+
+const TopologyModel_t &topology_model()
+{
+	return g_topology_model;
+}
+
+double predict_generation_time(
+	const std::pair<size_t, size_t> &topology,
+	const std::pair<size_t, size_t> &board_size,
+	const TopologyModel_t &model)
+{
+	const size_t columns = topology.first;
+	const size_t rows = topology.second;
+	const size_t processors = columns * rows;
+
+	// The slowest processor holds the largest subgrid and has the most links
+	double width = (board_size.first + columns - 1) / columns;
+	double height = (board_size.second + rows - 1) / rows;
+	double compute = width * height * model.cell_time;
+
+	// Consecutive ranks share a node, so a row neighbor is usually local, and
+	// a column neighbor is remote once a processor row spans a whole node.
+	// The slowest processor sits on a node boundary.
+	bool spans_nodes = processors > model.ranks_per_node;
+	size_t row_links = std::min<size_t>(2, columns - 1);
+	size_t column_links = std::min<size_t>(2, rows - 1);
+	size_t corner_links = row_links * column_links;
+	size_t remote_row_links = spans_nodes ? std::min<size_t>(1, row_links) : 0;
+	size_t remote_column_links = 0;
+	if(spans_nodes)
+		remote_column_links = (columns >= model.ranks_per_node) ? column_links : std::min<size_t>(1, column_links);
+	size_t remote_corner_links = remote_column_links * row_links;
+
+	double comm = 0;
+	comm += remote_row_links * (model.latency + height * model.byte_time);
+	comm += (row_links - remote_row_links) * (model.local_latency + height * model.local_byte_time);
+	comm += remote_column_links * (model.latency + width * model.byte_time);
+	comm += (column_links - remote_column_links) * (model.local_latency + width * model.local_byte_time);
+	comm += remote_corner_links * (model.latency + model.byte_time);
+	comm += (corner_links - remote_corner_links) * (model.local_latency + model.local_byte_time);
+
+	return compute + comm;
+}
+
+std::pair<size_t, size_t> calculate_topology(
+	int32_t comm_size,
+	const std::pair<size_t, size_t>& board_size)
+{
+	if(comm_size <= 0)
+		return std::make_pair(0, 0);
+	if(g_topology_override.first * g_topology_override.second == (size_t)comm_size)
+		return g_topology_override;
+
+	// Score every factorization, from 1D strips to square grids, in both
+	// orientations. Ties keep the first (widest) candidate.
+	std::pair<size_t, size_t> best = std::make_pair(comm_size, 1);
+	double best_time = -1;
+	for(size_t columns = comm_size; columns > 0; columns--)
+	{
+		if((comm_size % columns) != 0)
+			continue;
+
+		std::pair<size_t, size_t> candidate = std::make_pair(columns, comm_size / columns);
+		if(candidate.first > board_size.first || candidate.second > board_size.second)
+			continue;
+
+		double time = predict_generation_time(candidate, board_size, g_topology_model);
+		if(best_time < 0 || time < best_time)
+		{
+			best = candidate;
+			best_time = time;
+		}
+	}
+
+	return best;
+}
+
+size_t plan_processors(
+	int32_t comm_size,
+	size_t max_idle,
+	const std::pair<size_t, size_t> &board_size)
+{
+	size_t best = comm_size;
+	double best_time = -1;
+
+	// Fewer processors can win when comm_size factors poorly
+	for(size_t active = comm_size; active > 0 && (comm_size - active) <= max_idle; active--)
+	{
+		std::pair<size_t, size_t> topology = calculate_topology(active, board_size);
+		if(topology.first > board_size.first || topology.second > board_size.second)
+			continue;
+
+		double time = predict_generation_time(topology, board_size, g_topology_model);
+		if(best_time < 0 || time < best_time)
+		{
+			best = active;
+			best_time = time;
+		}
+	}
+
+	return best;
 }
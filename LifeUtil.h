@@ -16,16 +16,20 @@
 #include <ostream>
 #include <stdint.h>
 #include "Array2D.h"
+#include "TiledArray2D.h"
 
 // Alias a 2-d array of booleans used to represent a game of life board.
 typedef Array2D<bool> LifeBoard;
 
+// Alias a tiled game of life board.
+typedef TiledArray2D<bool> TiledLifeBoard;
+
 // Header information from a life file.
 struct LifeHeader_t
 {
-	uint32_t width;
-	uint32_t height;
-	uint32_t generations;
+	uint64_t width;
+	uint64_t height;
+	uint64_t generations;
 };
 
 // A rectangular region.
@@ -37,6 +41,78 @@ struct Region_t
 	size_t height;
 };
 
+// A function that advances a region of the board one generation.
+typedef void (*StepKernel_t)(
+	const Region_t &region,
+	const LifeBoard &src_generation,
+	LifeBoard &dst_generation);
+
+// Image file formats for frame output.
+enum ImageFormat_t
+{
+	IMAGE_PGM, // Binary portable graymap
+	IMAGE_PNG  // 8-bit grayscale PNG
+};
+
+// NUMA memory placement policies.
+enum NumaPolicy_t
+{
+	NUMA_DEFAULT,     // Leave placement to the system
+	NUMA_FIRST_TOUCH, // Have the threads that step each part of the board touch it first
+	NUMA_INTERLEAVE   // Spread the pages of every allocation across the nodes
+};
+
+// A pattern placed on a generated board with its top-left cell at (x, y).
+struct Stamp_t
+{
+	size_t pattern; // Index of the pattern (see find_pattern)
+	size_t x;
+	size_t y;
+};
+
+// Command line options shared by the serial and parallel programs.
+struct LifeOptions_t
+{
+	size_t depth; // Generations advanced per tile pass and halo depth (0 selects the default)
+	size_t tile;  // Edge length of a temporal blocking tile
+	StepKernel_t kernel; // Kernel used to advance each tile
+	bool batch;          // Treat the input file as a manifest of boards
+	bool serve;          // Serve requests on the socket named by the input file
+	size_t group_size;   // Processors that share one board in batch mode
+	bool compress;       // Send halos in a compact encoding
+	bool unbounded;      // Grow the board to follow the live cells
+	bool plan;           // Calibrate the topology cost model at startup
+	size_t max_idle;     // Processors the planner may leave idle
+	std::pair<size_t, size_t> topology; // Forced processor layout (see set_topology_override), or 0x0
+	bool has_window;     // Write only the window instead of the whole board
+	Region_t window;     // Window of the board to write
+	size_t density;      // Write live counts of density x density blocks
+	std::string frames;  // Path prefix of image frames, or empty for none
+	size_t frame_interval; // Generations between image frames
+	ImageFormat_t frame_format; // File format of image frames
+	size_t frame_block;  // Board cells per image pixel along each axis
+	std::string deltas;  // Path of the delta log of cell changes, or empty for none
+	size_t threads;      // Worker threads of the serial program (0 for one per core)
+	bool tiled;          // Store the serial program's board as tiles along a curve
+	TileOrder_t tile_order; // Curve that orders the tiles
+	bool autotune;       // Choose kernel, tile and depth by timing them at startup
+	std::string tune_cache; // File of earlier autotuning results
+	bool checksum;       // Print the board checksum at the end
+	size_t checksum_interval; // Also print it every this many generations (0 for never)
+	bool sparse;         // Read and write cell lists and run the sparse engine
+	bool has_query;      // Compute only the window at the query generation
+	size_t query;        // Generation of the window to compute
+	bool has_replay;     // Rebuild a generation from the delta log instead of simulating
+	size_t replay;       // Generation to rebuild
+	bool pin;            // Pin each processor or thread to its own core
+	NumaPolicy_t numa;   // NUMA placement of the boards
+	bool generate;       // Generate the board instead of reading the input file
+	LifeHeader_t generated; // Size and generations of the generated board
+	double fill;         // Fraction of generated cells that are alive
+	uint64_t seed;       // Seed of the generated cells
+	std::vector<Stamp_t> stamps; // Patterns placed on the generated board
+};
+
 // Read a game of life file from an input stream. Returns true on success.
 bool readFile(std::istream &in, LifeBoard &board, LifeHeader_t &header);
 
@@ -49,11 +125,139 @@ void step_region(
 	const LifeBoard &src_generation,
 	LifeBoard &dst_generation);
 
-// Calculate an optimal processor configuration for the game of life simulation.
+// Advance a region of the board one generation using a lookup table that maps
+// each 4x4 neighborhood to the next state of its inner 2x2 block, so four
+// cells are produced per table lookup.
+void step_region_lut(
+	const Region_t &region,
+	const LifeBoard &src_generation,
+	LifeBoard &dst_generation);
+
+// Advance a region of the board several generations, one cache-sized tile at
+// a time. Each tile is loaded with a margin of generations cells (clipped to
+// domain) and stepped in the scratch buffers; cells outside of domain are
+// dead. The scratch pair belongs to the caller, which should keep it between
+// calls: it is only grown when a tile and its margin do not fit.
+void step_region_temporal(
+	const Region_t &region,
+	const Region_t &domain,
+	const LifeBoard &src_generation,
+	LifeBoard &dst_generation,
+	size_t generations,
+	size_t tile_size,
+	LifeBoard scratch[2],
+	StepKernel_t kernel = step_region);
+
+// Advance board[index] the given number of generations, ping-ponging between
+// board[0] and board[1] up to depth generations per pass (at most the ghost
+// depth of the boards, which must have the same shape); index is left
+// pointing at the result. Each pass refreshes the ghosts and then advances
+// the tiles one at a time in layout order, each reading only its own block.
+void step_tiled_board(
+	TiledLifeBoard board[2],
+	bool &index,
+	size_t generations,
+	size_t depth,
+	StepKernel_t kernel = step_region);
+
+// Compute a window of the board as it will be the given number of
+// generations later into result (which is resized to the window). Only the
+// window's backward light cone is simulated: the cells within generations of
+// it, clipped to the board, are copied out, and each generation advances a
+// region one cell smaller on every side than the last, ending at the window.
+void query_window(
+	const LifeBoard &board,
+	const Region_t &window,
+	size_t generations,
+	LifeBoard &result,
+	StepKernel_t kernel = step_region);
+
+// Return the index of the pattern with the given name (glider, blinker,
+// block, rpentomino, acorn, diehard or gosper), or -1.
+int find_pattern(const std::string &name);
+
+// Fill a region of the board with the generated cells at the same global
+// coordinates (the position in the region plus the offsets). A cell is alive
+// if a hash of options.seed and its coordinates falls below options.fill, and
+// the stamps are drawn over that, so every cell depends only on the options
+// and its coordinates and any split of the board generates the same cells.
+void generate_region(
+	LifeBoard &board,
+	const Region_t &region,
+	size_t x_offset,
+	size_t y_offset,
+	const LifeOptions_t &options);
+
+// Return the kernel with the given name ("basic" or "lut"), or NULL.
+StepKernel_t find_kernel(const std::string &name);
+
+// Return the name of a kernel, or NULL if it is not one of find_kernel's.
+const char *kernel_name(StepKernel_t kernel);
+
+// Return the hash of a live cell at the given global coordinates that
+// checksums are sums of.
+uint64_t checksum_cell(uint64_t x, uint64_t y);
+
+// Return the sum, over the live cells of a region, of a 64-bit hash of each
+// cell's global coordinates (its position in the region plus the offsets).
+// Sums of disjoint regions add up to the sum of their union, so partial sums
+// can be combined in any order.
+uint64_t checksum_region(
+	const LifeBoard &board,
+	const Region_t &region,
+	size_t x_offset,
+	size_t y_offset);
+
+// Mix the board size into a sum of checksum_region results covering the
+// whole board, giving its checksum.
+uint64_t finish_checksum(uint64_t sum, uint64_t width, uint64_t height);
+
+// Write a board checksum line in the format shared by both programs.
+void print_checksum(std::ostream &out, size_t generation, uint64_t checksum);
+
+// Parse the optional arguments following the input and output files. Returns true on success.
+bool parse_options(int argc, char **argv, LifeOptions_t &options);
+
+// Parameters of the cost model used to choose a processor configuration.
+struct TopologyModel_t
+{
+	double latency;         // Seconds per message between nodes
+	double byte_time;       // Seconds per byte between nodes
+	double local_latency;   // Seconds per message within a node
+	double local_byte_time; // Seconds per byte within a node
+	double cell_time;       // Seconds to advance one cell one generation
+	size_t ranks_per_node;  // Consecutive ranks that share a node
+};
+
+// Make calculate_topology return a fixed configuration whenever it uses
+// exactly the number of processors asked for.
+void set_topology_override(const std::pair<size_t, size_t> &topology);
+
+// Replace the cost model. It must be identical on every processor.
+void set_topology_model(const TopologyModel_t &model);
+
+// Return the cost model in use.
+const TopologyModel_t &topology_model();
+
+// Predict the seconds per generation of a processor configuration.
+double predict_generation_time(
+	const std::pair<size_t, size_t> &topology,
+	const std::pair<size_t, size_t> &board_size,
+	const TopologyModel_t &model);
+
+// Calculate an optimal processor configuration for the game of life simulation:
+// the columns x rows factorization of comm_size with the lowest predicted time.
 std::pair<size_t, size_t> calculate_topology(
 	int32_t comm_size,
 	const std::pair<size_t, size_t>& board_size);
 
+// Return how many processors to use, leaving at most max_idle of comm_size
+// idle, so that the configuration from calculate_topology is fastest.
+size_t plan_processors(
+	int32_t comm_size,
+	size_t max_idle,
+	const std::pair<size_t, size_t> &board_size);
+
 #ifdef DEBUG
 
 // Write the contents of a life board to stdout.
@@ -13,53 +13,35 @@
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <algorithm>
 #include <mpi.h>
 
-#include "AsyncIO.h"
-#include "Array2D.h"
+#include "Parallel.h"
+#include "TaskGraph.h"
+#include "Batch.h"
+#include "Service.h"
+#include "SparseParallel.h"
+#include "Image.h"
 #include "LifeUtil.h"
 
-// Returns the coordinates of a processor given its index and the grid topology.
-std::pair<size_t, size_t> map_processor(size_t index, const std::pair<size_t, size_t> &topology);
-
-// Return the width of a processor's local board.
-size_t subgrid_width(size_t index, size_t columns, size_t board_width);
-
-// Return the height of a processor's local board.
-size_t subgrid_height(size_t index, size_t rows, size_t columns, size_t board_height);
-
-// Read the board and pass out the local segment. Returns true on success.
-bool scatter_board(std::istream &in, LifeBoard &local_board, LifeHeader_t &header);
-
-// Gather each processor's local segment and write it to the output stream. Returns true on success.
-bool gather_board(std::ostream &out, const LifeBoard &local_board, const LifeHeader_t &header);
-
-// Move a local board into a send buffer (removing margin and adding padding).
-void pad_buffer(const LifeBoard &board, bool *buffer);
-
-// Move the contents of a receive buffer into a board.
-void unpad_buffer(LifeBoard &board, const bool *buffer);
-
-// Calculate how the processor's local board maps onto the global board.
-std::pair<size_t, size_t> calculate_offsets(
-	const std::pair<size_t, size_t> &loc,
-	const std::pair<size_t, size_t> &topology,
-	const std::pair<size_t, size_t> &board_size);
-
-// Return status enumeration.
-enum Status_t
+// Return the file name of the image frame for a generation.
+static std::string frame_path(const LifeOptions_t &options, size_t generation)
 {
-	STATUS_SUCCESS     =  0,
-	STATUS_BAD_PARAMS  = (1 << 0),
-	STATUS_READ_ERROR  = (1 << 1),
-	STATUS_WRITE_ERROR = (1 << 2)
-};
+	std::stringstream ss;
+	ss << options.frames;
+	ss.width(6);
+	ss.fill('0');
+	ss << generation;
+	ss << ((options.frame_format == IMAGE_PNG) ? ".png" : ".pgm");
+	return ss.str();
+}
 
 int main(int argc, char **argv)
 {
 	LifeBoard board;
-	LifeBoard result_board;
 	LifeHeader_t header;
+	LifeOptions_t options;
+	size_t margin;
 	int32_t size;
 	int32_t rank;
 
@@ -67,308 +49,189 @@ int main(int argc, char **argv)
 	MPI_Comm_size( MPI_COMM_WORLD, &size );
 	MPI_Comm_rank( MPI_COMM_WORLD, &rank );
 
-	if(argc < 3)
+	if(argc < 3 || !parse_options(argc, argv, options))
+		MPI_Abort(MPI_COMM_WORLD, STATUS_BAD_PARAMS);
+
+	// Queries and replays are only done by the serial program
+	if(options.has_query || options.has_replay)
 		MPI_Abort(MPI_COMM_WORLD, STATUS_BAD_PARAMS);
+	set_topology_override(options.topology);
+
+	// Pin processors and set the memory policy before anything is allocated
+	place_processors(options);
+
+	if(options.plan)
+		calibrate_topology_model(options);
 
-	// Initialize the local board segment
-	std::ifstream in(argv[1]);
-	if(scatter_board(in, board, header))
+	// Run every board listed in a manifest
+	if(options.batch)
 	{
-		result_board.resize(board.width(), board.height());
+		Status_t status = run_batch(argv[1], argv[2], options);
+		MPI_Finalize();
+		return status;
 	}
-	else
+
+	// Serve requests until told to stop
+	if(options.serve)
 	{
-		MPI_Abort(MPI_COMM_WORLD, STATUS_READ_ERROR);
+		Status_t status = run_service(argv[1], argv[2], options);
+		MPI_Finalize();
+		return status;
 	}
-	in.close();
 
+	// Run a cell list on the sparse engine
+	if(options.sparse)
 	{
-		Region_t center = {2, 2, board.width() - 4, board.height() - 4};
-		Region_t north = {1, 1, board.width() - 2, 1};
-		Region_t south = {1, board.height() - 2, board.width() - 2, 1};
-		Region_t east = {board.width() - 2, 2, 1, board.height() - 4};
-		Region_t west = {1, 2, 1, board.height() - 4}; 
-
-		AsyncIO io(board, calculate_topology(size, 
-			std::make_pair(header.width, header.height)));
-		for(size_t i = 0; i < header.generations; i++)
+		if(options.unbounded || !options.deltas.empty() || !options.frames.empty() ||
+			options.has_window || options.density > 1)
 		{
-			io.begin();
-			step_region(center, board, result_board);	
-			io.end();
-
-			step_region(north, board, result_board);
-			step_region(south, board, result_board);
-			step_region(west, board, result_board);
-			step_region(east, board, result_board);
-
-			for(size_t y = 0; y < board.height(); y++)
-			{
-				for(size_t x = 0; x < board.width(); x++)
-				{
-					if(y == 0 || y == board.height() - 1)
-						board[y][x] = false;
-					else if(x == 0 || x == board.width() - 1)
-						board[y][x] = false;
-					else board[y][x] = result_board[y][x];
-				}
-			}
+			MPI_Abort(MPI_COMM_WORLD, STATUS_BAD_PARAMS);
 		}
+
+		Status_t status = run_sparse(argv[1], argv[2], options);
+		MPI_Finalize();
+		return status;
 	}
 
-	// Write the output.	
-	std::ofstream out(argv[2]);
-	if(!gather_board(out, board, header))
+	// Leave some processors idle if the board is faster on fewer
+	MPI_Comm comm = MPI_COMM_WORLD;
+	if(options.plan && options.generate)
 	{
-		MPI_Abort(MPI_COMM_WORLD, STATUS_WRITE_ERROR);
+		comm = plan_communicator(
+			std::make_pair(options.generated.width, options.generated.height), options.max_idle);
+	}
+	else if(options.plan)
+	{
+		comm = plan_communicator(argv[1], options.max_idle);
+	}
+	if(comm == MPI_COMM_NULL)
+	{
+		MPI_Finalize();
+		return STATUS_SUCCESS;
 	}
-	out.close();
-
-	MPI_Finalize();
-	return STATUS_SUCCESS;
-}
-
-bool scatter_board(std::istream &in, LifeBoard &local_board, LifeHeader_t &header)
-{
-	int32_t rank;
-	int32_t size;
-	LifeBoard board;
-	uint32_t parameters[3];
-	std::pair<size_t, size_t> topology;
-	std::pair<size_t, size_t> loc;
-	std::pair<size_t, size_t> offset;
-	std::pair<size_t, size_t> local_size;
-
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-	MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-	// Root processor reads the file
-	if(rank == 0)
+	// Initialize the local board segment, generating it in place if asked
+	margin = options.depth ? options.depth : 1;
+	if(options.generate)
 	{
-		if(readFile(in, board, header))
-		{
-			parameters[0] = header.width;
-			parameters[1] = header.height;
-			parameters[2] = header.generations;
-		}
-		else
+		if(!generate_board(board, header, margin, options, comm))
+			MPI_Abort(MPI_COMM_WORLD, STATUS_BAD_PARAMS);
+	}
+	else
+	{
+		std::ifstream in(argv[1]);
+		if(!scatter_board(in, board, header, margin, comm))
 		{
-			parameters[0] = 0;
-			parameters[1] = 0;
-			parameters[2] = 0;
+			MPI_Abort(MPI_COMM_WORLD, STATUS_READ_ERROR);
 		}
+		in.close();
 	}
 
-	// Send the header to each processor
-	MPI_Bcast(parameters, 3, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-	header.width = parameters[0];
-	header.height = parameters[1];
-	header.generations = parameters[2];
-	if(header.width == 0 || header.height == 0)
-		return false;
-	topology = calculate_topology(size, std::make_pair(header.width, header.height));
-	loc = map_processor(rank, topology);
-
-	if(rank != 0)
-		board.resize(header.width, header.height);
-
-	// Resize local board with a margin of 1 row/column
-	local_size = std::make_pair(
-		subgrid_width(rank, topology.first, header.width) + 2,
-		subgrid_height(rank, topology.second, topology.first, header.height) + 2);
-	local_board.resize(local_size.first, local_size.second);
+	// Pick the fastest kernel, tile and depth for this board
+	if(options.autotune)
+		autotune(board, header, margin, options, comm);
 
-	// Send the file contents to each processor 
-	MPI_Bcast(
-		board[0],
-		board.width() * board.height(),
-		MPI_CHAR,
-		0,
-		MPI_COMM_WORLD);
-
-	// Find this processors chunk of the board
-	offset = calculate_offsets(
-		loc,
-		topology,
-		std::make_pair(board.width(), board.height()));
+	// The delta log follows a fixed board
+	DeltaLog_t log;
+	const bool deltas = !options.deltas.empty();
+	if(deltas && options.unbounded)
+		MPI_Abort(MPI_COMM_WORLD, STATUS_BAD_PARAMS);
+	if(deltas && !open_delta_log(options.deltas, header, log, comm))
+		MPI_Abort(MPI_COMM_WORLD, STATUS_WRITE_ERROR);
 
-	// Copy the chunk into the local board with a margin of 1 cell
-	for(size_t y = 0; y < local_board.height(); y++)
+	// Advance the board, stopping to write an image frame every frame_interval
+	// generations, to print the checksum every checksum_interval generations,
+	// and after every generation to log its changes, as requested. One task
+	// graph (and its halo exchange) serves every stretch of generations.
+	const size_t generations = header.generations;
+	std::pair<int64_t, int64_t> origin = std::make_pair(0, 0);
+	TaskGraph *graph = NULL;
+	for(size_t generation = 0;;)
 	{
-		for(size_t x = 0; x < local_board.width(); x++)
+		bool last = (generation == generations);
+		if(!options.frames.empty() && (last || (generation % options.frame_interval) == 0) &&
+			!write_frame(frame_path(options, generation), options.frame_format,
+			board, header, margin, options.frame_block, comm))
 		{
-			if((x == 0) || (y == 0) || (x == local_board.width() - 1) || (y == local_board.height() - 1))
-				local_board[y][x] = false;
-			else
-				local_board[y][x] = board[y + offset.second - 1][x + offset.first - 1];
+			MPI_Abort(MPI_COMM_WORLD, STATUS_WRITE_ERROR);
 		}
-	}
-
-	return true;
-}
 
-void pad_buffer(const LifeBoard &board, bool *buffer)
-{	
-	size_t buffer_index = 0;
-	for(size_t y = 1; y < (board.height()) - 1; y++)
-	{
-		for(size_t x = 1; x < (board.width()) - 1; x++)
+		if((options.checksum && last) ||
+			(options.checksum_interval && (generation % options.checksum_interval) == 0))
 		{
-			buffer[buffer_index++] = board[y][x];
+			uint64_t checksum = board_checksum(board, header, margin, comm);
+			if(rank == 0)
+				print_checksum(std::cout, generation, checksum);
 		}
-	}
-}
-
-void unpad_buffer(LifeBoard &board, const bool *buffer)
-{
-	int32_t rank;
-	int32_t size;
-	std::pair<size_t, size_t> topology;
-	std::pair<size_t, size_t> subgrid_size;
 
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-	MPI_Comm_size(MPI_COMM_WORLD, &size);
-	topology = calculate_topology(size, std::make_pair(board.width(), board.height()));
-	subgrid_size = std::make_pair(
-		subgrid_width(0, topology.first, board.width()),
-		subgrid_height(0, topology.second, topology.first, board.height()));
+		if(generation >= generations)
+			break;
 
-	size_t by = 0; // board x-index
-	size_t bx = 0; // board y-index
+		size_t steps = generations - generation;
+		if(!options.frames.empty())
+			steps = std::min(steps, options.frame_interval - (generation % options.frame_interval));
+		if(options.checksum_interval)
+			steps = std::min(steps, options.checksum_interval - (generation % options.checksum_interval));
+		if(deltas)
+			steps = 1;
 
-	// Loop through processor rows
-	for(size_t ty = 0; ty < topology.second; ty++)
-	{
-		// Number of rows in the current processor row
-		size_t height = subgrid_height(
-			ty * topology.first,
-			topology.second,
-			topology.first,
-			board.height());
-
-		// Loop through rows of the board in the current processor row
-		for(size_t y = 0; y < height; y++, by++)
+		if(options.unbounded)
 		{
-	
-			// Loop through processor columns
-			for(size_t tx = 0, bx = 0; tx < topology.first; tx++)
-			{
-				// Number of columns in the current processor column
-				size_t width = subgrid_width(
-					(ty * topology.first) + tx,
-					topology.first,
-					board.width());
-
-				// Loop through columns of the current processor column
-				for(size_t x = 0; x < width; x++)
-				{
-
-					// Copy the cell into the the board position
-					size_t index =
-						((ty * topology.first) + tx) * 
-						(subgrid_size.first * subgrid_size.second);
-					index += (y * width) + x;
-					board[by][bx++] = buffer[index];	
-				}
-			}
+			std::pair<int64_t, int64_t> shift = simulate_unbounded(
+				board, header, margin, steps, options, graph, comm);
+			origin.first += shift.first;
+			origin.second += shift.second;
+		}
+		else
+		{
+			if(graph == NULL)
+				graph = create_task_graph(board, header, margin, options, comm);
+			graph->run(steps, deltas);
 		}
-	}
-}
-
-bool gather_board(std::ostream &out, const LifeBoard &local_board, const LifeHeader_t &header)
-{
-	int32_t rank;
-	int32_t size;
-	size_t send_size;
-	bool *send_buffer;
-	bool *recv_buffer;
-	bool result;
-	std::pair<size_t, size_t> topology;
-	std::pair<size_t, size_t> subgrid_size;
-	
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-	MPI_Comm_size(MPI_COMM_WORLD, &size);
-	topology = calculate_topology(size, std::make_pair(header.width, header.height));
-	subgrid_size = std::make_pair(
-		subgrid_width(0, topology.first, header.width),
-		subgrid_height(0, topology.second, topology.first, header.height));
 
-	// The usual &vector[0] trick was causing issues; using raw arrays as a fallback.
-	send_size = subgrid_size.first * subgrid_size.second;
-	send_buffer = new bool[subgrid_size.first * subgrid_size.second];
-	recv_buffer = new bool[(topology.first * topology.second) * (subgrid_size.first * subgrid_size.second)];
-	pad_buffer(local_board, send_buffer);
+		if(deltas && !write_deltas(log, graph->previous(), board, header, margin, comm))
+			MPI_Abort(MPI_COMM_WORLD, STATUS_WRITE_ERROR);
+		generation += steps;
+	}
+	delete graph;
 
-	MPI_Gather(
-		send_buffer,
-		send_size,
-		MPI_CHAR,
-		recv_buffer,
-		send_size,
-		MPI_CHAR,
-		0,
-		MPI_COMM_WORLD);
+	if(deltas)
+		close_delta_log(log);
 
-	// Write the result to the output stream	
-	if(rank == 0)
-	{
-		LifeBoard board(header.width, header.height);
-		unpad_buffer(board, recv_buffer);
-		result = writeFile(out, board, header);
-	}
-	else
+	if(options.unbounded && rank == 0)
 	{
-		result = true;
+		std::cout << "Board is " << header.width << "x" << header.height
+			<< "; input origin at (" << origin.first << ", " << origin.second << ")" << std::endl;
 	}
-	
-	delete [] send_buffer;
-	delete [] recv_buffer;
-	return result;
-}
 
-std::pair<size_t, size_t> map_processor(size_t index, const std::pair<size_t, size_t> &topology)
-{
-	size_t x = index % topology.first;
-	size_t y = index / topology.first;
-	return std::pair<size_t, size_t>(x, y);
-}
-
-size_t subgrid_width(size_t index, size_t columns, size_t board_width)
-{
-	size_t column = index % columns;
-	if((board_width % columns) > column)
-		return (board_width / columns) + 1;
-	else
-		return (board_width / columns);
-}
-
-size_t subgrid_height(size_t index, size_t rows, size_t columns, size_t board_height)
-{
-	size_t row = index / columns;
-	if((board_height % rows) > row)
-		return (board_height / rows) + 1;
-	else
-		return (board_height / rows);
-}
-
-std::pair<size_t, size_t> calculate_offsets(
-	const std::pair<size_t, size_t> &loc,
-	const std::pair<size_t, size_t> &topology,
-	const std::pair<size_t, size_t> &board_size)
-{
-	std::pair<size_t, size_t> result = std::make_pair(0, 0);
-
-	// Sum subgrid heights for prior rows
-	for(size_t y = 0; y < loc.second; y++)
+	// Write the output.	
+	std::ofstream out(argv[2]);
+	if(options.has_window || options.density > 1)
 	{
-		result.second += subgrid_height(y * topology.first, topology.second, topology.first, board_size.second);
-	}
+		// Clip the window to the board
+		Region_t window = {0, 0, header.width, header.height};
+		if(options.has_window)
+		{
+			window = options.window;
+			if(window.x_start >= header.width || window.y_start >= header.height)
+				MPI_Abort(MPI_COMM_WORLD, STATUS_BAD_PARAMS);
+			window.width = std::min<size_t>(window.width, header.width - window.x_start);
+			window.height = std::min<size_t>(window.height, header.height - window.y_start);
+		}
 
-	// Sum subgrid widths for all prior columns
-	for(size_t x = 0; x < loc.first; x++)
+		if(!gather_window(out, board, header, margin, window, options.density, comm))
+		{
+			MPI_Abort(MPI_COMM_WORLD, STATUS_WRITE_ERROR);
+		}
+	}
+	else if(!gather_board(out, board, header, margin, comm))
 	{
-		result.first += subgrid_width(x, topology.first, board_size.first);
+		MPI_Abort(MPI_COMM_WORLD, STATUS_WRITE_ERROR);
 	}
+	out.close();
 
-	return result;
+	if(comm != MPI_COMM_WORLD)
+		MPI_Comm_free(&comm);
+	MPI_Finalize();
+	return STATUS_SUCCESS;
 }
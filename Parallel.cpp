@@ -0,0 +1,1290 @@
+/*
+ *       File:           Parallel.cpp
+ *       Description:    Implementation of board distribution and the parallel engine
+ *
+ */
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <vector>
+
+#include "AsyncIO.h"
+#include "Delta.h"
+#include "Placement.h"
+#include "TaskGraph.h"
+#include "Parallel.h"
+
+// Bytes per block of large transfers, which are counted in blocks.
+#define LARGE_BLOCK (1 << 30)
+
+// Counts of a window reduced at a time by gather_window.
+#define WINDOW_BAND_BLOCKS (1 << 22)
+
+Region_t simulation_domain(
+	const LifeBoard &board,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm)
+{
+	int32_t size;
+	int32_t rank;
+
+	MPI_Comm_size(comm, &size);
+	MPI_Comm_rank(comm, &rank);
+
+	const size_t width = board.width() - (2 * margin);
+	const size_t height = board.height() - (2 * margin);
+	std::pair<size_t, size_t> topology = calculate_topology(size,
+		std::make_pair(header.width, header.height));
+	std::pair<size_t, size_t> loc = map_processor(rank, topology);
+
+	// Ghost cells past the edge of the global board are always dead
+	Region_t domain = {margin, margin, width, height};
+	if(loc.first > 0)
+	{
+		domain.x_start -= margin;
+		domain.width += margin;
+	}
+	if(loc.first + 1 < topology.first)
+		domain.width += margin;
+	if(loc.second > 0)
+	{
+		domain.y_start -= margin;
+		domain.height += margin;
+	}
+	if(loc.second + 1 < topology.second)
+		domain.height += margin;
+
+	return domain;
+}
+
+TaskGraph *create_task_graph(
+	LifeBoard &board,
+	const LifeHeader_t &header,
+	size_t margin,
+	const LifeOptions_t &options,
+	MPI_Comm comm)
+{
+	int32_t size;
+
+	MPI_Comm_size(comm, &size);
+
+	std::pair<size_t, size_t> topology = calculate_topology(size,
+		std::make_pair(header.width, header.height));
+	Region_t domain = simulation_domain(board, header, margin, comm);
+	return new TaskGraph(board, topology, margin, domain, options, comm);
+}
+
+void simulate(
+	LifeBoard &board,
+	const LifeHeader_t &header,
+	size_t margin,
+	size_t generations,
+	const LifeOptions_t &options,
+	MPI_Comm comm)
+{
+	// Exchange a margin deep halo, then advance up to margin generations,
+	// letting tiles run ahead as far as their dependencies allow
+	TaskGraph *graph = create_task_graph(board, header, margin, options, comm);
+	graph->run(generations);
+	delete graph;
+}
+
+// A rectangle in signed global coordinates.
+struct Window_t
+{
+	int64_t x;
+	int64_t y;
+	int64_t width;
+	int64_t height;
+};
+
+// Return the overlap of two windows (empty windows have no area).
+static Window_t intersect(const Window_t &a, const Window_t &b)
+{
+	int64_t x0 = std::max(a.x, b.x);
+	int64_t y0 = std::max(a.y, b.y);
+	int64_t x1 = std::min(a.x + a.width, b.x + b.width);
+	int64_t y1 = std::min(a.y + a.height, b.y + b.height);
+	Window_t result = {x0, y0, std::max<int64_t>(0, x1 - x0), std::max<int64_t>(0, y1 - y0)};
+	return result;
+}
+
+// Return the global window owned by a processor, shifted by an origin.
+static Window_t owned_window(
+	size_t index,
+	const std::pair<size_t, size_t> &topology,
+	const LifeHeader_t &header,
+	int64_t x_origin,
+	int64_t y_origin)
+{
+	Region_t region = subgrid_region(index, topology, std::make_pair(header.width, header.height));
+	Window_t result = {
+		(int64_t)region.x_start - x_origin,
+		(int64_t)region.y_start - y_origin,
+		(int64_t)region.width,
+		(int64_t)region.height};
+	return result;
+}
+
+void reframe(
+	LifeBoard &board,
+	LifeHeader_t &header,
+	size_t &margin,
+	size_t depth,
+	int64_t x_origin,
+	int64_t y_origin,
+	size_t width,
+	size_t height,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+	LifeHeader_t new_header = {width, height, header.generations};
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	std::pair<size_t, size_t> old_topology = calculate_topology(size,
+		std::make_pair(header.width, header.height));
+	std::pair<size_t, size_t> new_topology = calculate_topology(size,
+		std::make_pair(new_header.width, new_header.height));
+	Window_t old_mine = owned_window(rank, old_topology, header, x_origin, y_origin);
+	Window_t new_mine = owned_window(rank, new_topology, new_header, 0, 0);
+
+	// Cells that were outside of the old frame stay dead
+	size_t new_margin = clamp_margin(depth, new_header, new_topology);
+	LifeBoard local_board(new_mine.width + (2 * new_margin), new_mine.height + (2 * new_margin));
+
+	// Move the cells each pair of processors shares from the old local board
+	// straight into the new one, described by a datatype on each side. Halo
+	// receives match any tag, so this uses a communicator of its own.
+	MPI_Comm parts;
+	MPI_Comm_dup(comm, &parts);
+	std::vector<MPI_Request> requests;
+	for(int32_t p = 0; p < size; p++)
+	{
+		Window_t overlap = intersect(owned_window(p, old_topology, header, x_origin, y_origin), new_mine);
+		if(overlap.width <= 0 || overlap.height <= 0)
+			continue;
+
+		MPI_Datatype type;
+		MPI_Type_vector(overlap.height, overlap.width, local_board.stride(), MPI_CHAR, &type);
+		MPI_Type_commit(&type);
+		requests.push_back(MPI_REQUEST_NULL);
+		MPI_Irecv(&local_board[new_margin + (overlap.y - new_mine.y)][new_margin + (overlap.x - new_mine.x)],
+			1, type, p, 0, parts, &requests.back());
+		MPI_Type_free(&type);
+	}
+	for(int32_t q = 0; q < size; q++)
+	{
+		Window_t overlap = intersect(old_mine, owned_window(q, new_topology, new_header, 0, 0));
+		if(overlap.width <= 0 || overlap.height <= 0)
+			continue;
+
+		MPI_Datatype type;
+		MPI_Type_vector(overlap.height, overlap.width, board.stride(), MPI_CHAR, &type);
+		MPI_Type_commit(&type);
+		requests.push_back(MPI_REQUEST_NULL);
+		MPI_Isend(&board[margin + (overlap.y - old_mine.y)][margin + (overlap.x - old_mine.x)],
+			1, type, q, 0, parts, &requests.back());
+		MPI_Type_free(&type);
+	}
+	MPI_Waitall(requests.size(), requests.empty() ? NULL : &requests[0], MPI_STATUSES_IGNORE);
+	MPI_Comm_free(&parts);
+
+	board = std::move(local_board);
+	header = new_header;
+	margin = new_margin;
+}
+
+bool live_bounds(
+	const LifeBoard &board,
+	const LifeHeader_t &header,
+	size_t margin,
+	Region_t &bounds,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	std::pair<size_t, size_t> topology = calculate_topology(size,
+		std::make_pair(header.width, header.height));
+	Region_t mine = subgrid_region(rank, topology, std::make_pair(header.width, header.height));
+
+	// Reduce the negated minimums alongside the maximums with a single MPI_MAX
+	long long local[4] = {-LLONG_MAX, -LLONG_MAX, -1, -1};
+	long long global[4];
+	for(size_t y = 0; y < mine.height; y++)
+	{
+		const bool *row = board[margin + y] + margin;
+		for(size_t x = 0; x < mine.width; x++)
+		{
+			if(row[x])
+			{
+				long long gx = mine.x_start + x;
+				long long gy = mine.y_start + y;
+				local[0] = std::max(local[0], -gx);
+				local[1] = std::max(local[1], -gy);
+				local[2] = std::max(local[2], gx);
+				local[3] = std::max(local[3], gy);
+			}
+		}
+	}
+
+	MPI_Allreduce(local, global, 4, MPI_LONG_LONG, MPI_MAX, comm);
+	if(global[2] < 0)
+		return false;
+
+	bounds.x_start = -global[0];
+	bounds.y_start = -global[1];
+	bounds.width = global[2] + 1 - bounds.x_start;
+	bounds.height = global[3] + 1 - bounds.y_start;
+	return true;
+}
+
+std::pair<int64_t, int64_t> simulate_unbounded(
+	LifeBoard &board,
+	LifeHeader_t &header,
+	size_t &margin,
+	size_t generations,
+	const LifeOptions_t &options,
+	TaskGraph *&graph,
+	MPI_Comm comm)
+{
+	int32_t size;
+	std::pair<int64_t, int64_t> origin = std::make_pair(0, 0);
+	const int64_t interval = UNBOUNDED_INTERVAL;
+
+	MPI_Comm_size(comm, &size);
+
+	size_t steps;
+	for(size_t i = 0; i < generations; i += steps)
+	{
+		steps = std::min<size_t>(interval, generations - i);
+
+		// Nothing can be born more than steps cells away from a live cell, so
+		// the edge has no effect as long as the live cells keep that distance
+		Region_t bounds;
+		if(live_bounds(board, header, margin, bounds, comm))
+		{
+			int64_t x0 = bounds.x_start;
+			int64_t y0 = bounds.y_start;
+			int64_t x1 = x0 + bounds.width;
+			int64_t y1 = y0 + bounds.height;
+			bool near_edge =
+				(x0 < interval) || (y0 < interval) ||
+				(x1 + interval > (int64_t)header.width) ||
+				(y1 + interval > (int64_t)header.height);
+
+			// Refit around the live cells with room to spare on every side
+			int64_t pad = std::max<int64_t>(2 * interval,
+				std::max<int64_t>(bounds.width, bounds.height) / 2);
+			int64_t width = std::max<int64_t>(bounds.width + (2 * pad), 2 * size);
+			int64_t height = std::max<int64_t>(bounds.height + (2 * pad), 2 * size);
+			bool too_large = (uint64_t)(4 * width * height) < (header.width * header.height);
+
+			if(near_edge || too_large)
+			{
+				int64_t x_origin = x0 - ((width - bounds.width) / 2);
+				int64_t y_origin = y0 - ((height - bounds.height) / 2);
+				size_t depth = options.depth ? options.depth : 1;
+				delete graph;
+				graph = NULL;
+				reframe(board, header, margin, depth, x_origin, y_origin, width, height, comm);
+				origin.first -= x_origin;
+				origin.second -= y_origin;
+			}
+		}
+
+		if(graph == NULL)
+			graph = create_task_graph(board, header, margin, options, comm);
+		graph->run(steps);
+	}
+
+	return origin;
+}
+
+// Return the one-way time of a message between processor 0 and a partner.
+static double ping_pong(int32_t partner, size_t bytes, size_t repeats, MPI_Comm comm)
+{
+	int32_t rank;
+	std::vector<char> buffer(bytes);
+
+	MPI_Comm_rank(comm, &rank);
+
+	double start = MPI_Wtime();
+	for(size_t i = 0; i < repeats; i++)
+	{
+		if(rank == 0)
+		{
+			MPI_Send(&buffer[0], bytes, MPI_CHAR, partner, 0, comm);
+			MPI_Recv(&buffer[0], bytes, MPI_CHAR, partner, 0, comm, MPI_STATUS_IGNORE);
+		}
+		else if(rank == partner)
+		{
+			MPI_Recv(&buffer[0], bytes, MPI_CHAR, 0, 0, comm, MPI_STATUS_IGNORE);
+			MPI_Send(&buffer[0], bytes, MPI_CHAR, 0, 0, comm);
+		}
+	}
+	return (MPI_Wtime() - start) / (2 * repeats);
+}
+
+void calibrate_topology_model(const LifeOptions_t &options, MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+	int32_t node_size;
+	int32_t node_leader;
+	MPI_Comm node;
+	TopologyModel_t model = topology_model();
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	// Processors that share memory form a node, named by its lowest rank
+	MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+	MPI_Comm_size(node, &node_size);
+	node_leader = rank;
+	MPI_Bcast(&node_leader, 1, MPI_INT, 0, node);
+	MPI_Comm_free(&node);
+
+	int32_t largest_node;
+	std::vector<int32_t> leaders(size);
+	MPI_Allreduce(&node_size, &largest_node, 1, MPI_INT, MPI_MAX, comm);
+	MPI_Allgather(&node_leader, 1, MPI_INT, &leaders[0], 1, MPI_INT, comm);
+	model.ranks_per_node = largest_node;
+
+	// Time small and large messages to a local and a remote partner of processor 0
+	const size_t small = 1;
+	const size_t large = 1 << 18;
+	for(int32_t remote = 0; remote < 2; remote++)
+	{
+		int32_t partner = 0;
+		for(int32_t r = 1; r < size && partner == 0; r++)
+		{
+			if((leaders[r] != leaders[0]) == (remote != 0))
+				partner = r;
+		}
+		if(partner == 0)
+			continue;
+
+		double latency = ping_pong(partner, small, 100, comm);
+		double byte_time = std::max(0.0, ping_pong(partner, large, 10, comm) - latency) / large;
+		if(remote)
+		{
+			model.latency = latency;
+			model.byte_time = byte_time;
+		}
+		else
+		{
+			model.local_latency = latency;
+			model.local_byte_time = byte_time;
+		}
+	}
+
+	// Time the kernel on a random board
+	if(rank == 0)
+	{
+		const size_t edge = 256;
+		const size_t generations = 4;
+		LifeBoard board[2];
+		board[0].resize(edge, edge);
+		board[1].resize(edge, edge);
+
+		uint32_t state = 12345;
+		for(size_t y = 0; y < edge; y++)
+		{
+			for(size_t x = 0; x < edge; x++)
+			{
+				state = (state * 1103515245) + 12345;
+				board[0][y][x] = ((state >> 16) % 10) < 3;
+			}
+		}
+
+		Region_t region = {0, 0, edge, edge};
+		LifeBoard scratch[2];
+		double start = MPI_Wtime();
+		step_region_temporal(region, region, board[0], board[1], generations, options.tile, scratch, options.kernel);
+		model.cell_time = (MPI_Wtime() - start) / (edge * edge * generations);
+	}
+
+	// Every processor must plan with the same model
+	double values[5] = {
+		model.latency,
+		model.byte_time,
+		model.local_latency,
+		model.local_byte_time,
+		model.cell_time};
+	MPI_Bcast(values, 5, MPI_DOUBLE, 0, comm);
+	model.latency = values[0];
+	model.byte_time = values[1];
+	model.local_latency = values[2];
+	model.local_byte_time = values[3];
+	model.cell_time = values[4];
+	set_topology_model(model);
+}
+
+// Return the key of a tuning result: machine, board size and processor count.
+static std::string tune_key(const LifeHeader_t &header, MPI_Comm comm)
+{
+	int32_t size;
+	int length;
+	char name[MPI_MAX_PROCESSOR_NAME];
+
+	MPI_Comm_size(comm, &size);
+	MPI_Get_processor_name(name, &length);
+
+	std::stringstream ss;
+	ss << name << " " << header.width << " " << header.height << " " << size;
+	return ss.str();
+}
+
+// Look up the last result for key in a tuning cache. Returns true if found.
+static bool read_tune_cache(
+	const std::string &path,
+	const std::string &key,
+	std::string &kernel,
+	size_t &tile,
+	size_t &depth)
+{
+	std::ifstream in(path.c_str());
+	std::string line;
+	bool found = false;
+
+	while(std::getline(in, line))
+	{
+		// Lines are "<host> <width> <height> <processors> <kernel> <tile> <depth>"
+		std::stringstream ss(line);
+		std::string host, width, height, processors, name;
+		size_t line_tile, line_depth;
+		if(!(ss >> host >> width >> height >> processors >> name >> line_tile >> line_depth))
+			continue;
+		if((host + " " + width + " " + height + " " + processors) != key)
+			continue;
+		if(find_kernel(name) == NULL || line_tile == 0 || line_depth == 0)
+			continue;
+
+		kernel = name;
+		tile = line_tile;
+		depth = line_depth;
+		found = true;
+	}
+
+	return found;
+}
+
+void autotune(
+	LifeBoard &board,
+	LifeHeader_t &header,
+	size_t &margin,
+	LifeOptions_t &options,
+	MPI_Comm comm)
+{
+	static const char *kernels[] = {"basic", "lut"};
+	static const size_t tiles[] = {64, 128, 256};
+	static const size_t depths[] = {1, 2, 4, 8};
+	const size_t kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+	const size_t tile_count = sizeof(tiles) / sizeof(tiles[0]);
+	const size_t depth_count = sizeof(depths) / sizeof(depths[0]);
+
+	int32_t rank;
+	MPI_Comm_rank(comm, &rank);
+
+	// The root's machine names the cache entry; its answer is shared
+	std::string key = tune_key(header, comm);
+	uint32_t choice[4] = {0, 0, 0, 0}; // Found, kernel index, tile, depth
+	if(rank == 0)
+	{
+		std::string name;
+		size_t tile;
+		size_t depth;
+		if(read_tune_cache(options.tune_cache, key, name, tile, depth))
+		{
+			choice[0] = 1;
+			choice[1] = (name == kernels[1]);
+			choice[2] = tile;
+			choice[3] = depth;
+		}
+	}
+	MPI_Bcast(choice, 4, MPI_UNSIGNED, 0, comm);
+
+	if(!choice[0])
+	{
+		double best = -1.0;
+		size_t last_margin = 0;
+		for(size_t d = 0; d < depth_count; d++)
+		{
+			// Depths that clamp to one already tried are skipped
+			reframe(board, header, margin, depths[d], 0, 0, header.width, header.height, comm);
+			if(margin == last_margin)
+				continue;
+			last_margin = margin;
+
+			for(size_t k = 0; k < kernel_count; k++)
+			{
+				for(size_t t = 0; t < tile_count; t++)
+				{
+					LifeOptions_t trial = options;
+					trial.kernel = find_kernel(kernels[k]);
+					trial.tile = tiles[t];
+					trial.depth = margin;
+
+					LifeBoard copy = board;
+					MPI_Barrier(comm);
+					double start = MPI_Wtime();
+					simulate(copy, header, margin, TUNE_GENERATIONS, trial, comm);
+					double elapsed = MPI_Wtime() - start;
+					MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+					if(best < 0.0 || elapsed < best)
+					{
+						best = elapsed;
+						choice[1] = k;
+						choice[2] = tiles[t];
+						choice[3] = margin;
+					}
+				}
+			}
+		}
+
+		if(rank == 0)
+		{
+			std::ofstream out(options.tune_cache.c_str(), std::ios::app);
+			out << key << " " << kernels[choice[1]] << " " << choice[2] << " " << choice[3] << std::endl;
+		}
+	}
+
+	options.kernel = find_kernel(kernels[choice[1]]);
+	options.tile = choice[2];
+	if(margin != choice[3])
+		reframe(board, header, margin, choice[3], 0, 0, header.width, header.height, comm);
+	options.depth = margin;
+
+	if(rank == 0)
+	{
+		std::cout << "Tuned to kernel " << kernel_name(options.kernel) << ", tile " << options.tile
+			<< ", depth " << margin << (choice[0] ? " (cached)" : "") << std::endl;
+	}
+}
+
+MPI_Comm plan_communicator(const char *path, size_t max_idle, MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+	uint64_t board_size[2] = {0, 0};
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	// The file starts with the height and then the width
+	if(rank == 0)
+	{
+		std::ifstream in(path);
+		in >> board_size[1] >> board_size[0];
+		if(!in.good())
+			board_size[0] = board_size[1] = 0;
+	}
+	MPI_Bcast(board_size, 2, MPI_UINT64_T, 0, comm);
+	if(board_size[0] == 0 || board_size[1] == 0)
+		return comm;
+
+	return plan_communicator(std::make_pair(board_size[0], board_size[1]), max_idle, comm);
+}
+
+MPI_Comm plan_communicator(
+	const std::pair<size_t, size_t> &board,
+	size_t max_idle,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	size_t active = plan_processors(size, max_idle, board);
+	if(rank == 0)
+	{
+		std::pair<size_t, size_t> topology = calculate_topology(active, board);
+		std::cout << "Using " << active << " of " << size << " processors as "
+			<< topology.first << "x" << topology.second << ", predicted "
+			<< predict_generation_time(topology, board, topology_model()) * 1e6
+			<< "us per generation" << std::endl;
+	}
+	if(active == (size_t)size)
+		return comm;
+
+	MPI_Comm result;
+	MPI_Comm_split(comm, (rank < (int32_t)active) ? 0 : MPI_UNDEFINED, rank, &result);
+	return result;
+}
+
+uint64_t population(const LifeBoard &board, size_t margin, MPI_Comm comm)
+{
+	unsigned long long local = 0;
+	unsigned long long total = 0;
+
+	for(size_t y = margin; y < board.height() - margin; y++)
+	{
+		for(size_t x = margin; x < board.width() - margin; x++)
+		{
+			local += board[y][x];
+		}
+	}
+
+	MPI_Reduce(&local, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, comm);
+	return total;
+}
+
+uint64_t board_checksum(
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	std::pair<size_t, size_t> board_size = std::make_pair(header.width, header.height);
+	std::pair<size_t, size_t> topology = calculate_topology(size, board_size);
+	Region_t mine = subgrid_region(rank, topology, board_size);
+	Region_t owned = {margin, margin, mine.width, mine.height};
+
+	unsigned long long local = checksum_region(local_board, owned, mine.x_start, mine.y_start);
+	unsigned long long total = 0;
+	MPI_Reduce(&local, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, comm);
+
+	return finish_checksum(total, header.width, header.height);
+}
+
+bool scatter_board(
+	std::istream &in,
+	LifeBoard &local_board,
+	LifeHeader_t &header,
+	size_t &margin,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+	uint64_t parameters[3] = {0, 0, 0};
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	// Root processor reads the header
+	if(rank == 0 && in.good())
+	{
+		in >> parameters[0] >> parameters[1] >> parameters[2];
+		if(!in.good())
+			parameters[0] = parameters[1] = 0;
+	}
+
+	// Send the header to each processor
+	MPI_Bcast(parameters, 3, MPI_UINT64_T, 0, comm);
+	header.height = parameters[0];
+	header.width = parameters[1];
+	header.generations = parameters[2];
+	if(header.width == 0 || header.height == 0)
+		return false;
+
+	std::pair<size_t, size_t> board_size = std::make_pair(header.width, header.height);
+	std::pair<size_t, size_t> topology = calculate_topology(size, board_size);
+	margin = clamp_margin(margin, header, topology);
+
+	// Resize local board with a margin on each side
+	Region_t mine = subgrid_region(rank, topology, board_size);
+	local_board.resize(mine.width + (2 * margin), mine.height + (2 * margin));
+
+	// The parts travel on a communicator of their own, apart from the halos
+	MPI_Comm parts;
+	MPI_Comm_dup(comm, &parts);
+
+	// The owned cells, received straight into the local board
+	MPI_Datatype owned;
+	MPI_Type_vector(mine.height, mine.width, local_board.stride(), MPI_CHAR, &owned);
+	MPI_Type_commit(&owned);
+	bool *origin = local_board[margin] + margin;
+
+	int ok = 1;
+	if(rank != 0)
+	{
+		MPI_Recv(origin, 1, owned, 0, 0, parts, MPI_STATUS_IGNORE);
+	}
+	else
+	{
+		// Parse one processor row's band of the file at a time and send each
+		// processor its part while the next band is parsed. A band's buffers
+		// are reused two bands later, once its sends are done.
+		LifeBoard band[2];
+		std::vector<MPI_Request> requests[2];
+		size_t y_start = 0;
+		for(size_t row = 0; row < topology.second; row++)
+		{
+			const int b = row & 1;
+			MPI_Waitall(requests[b].size(), requests[b].empty() ? NULL : &requests[b][0], MPI_STATUSES_IGNORE);
+			requests[b].clear();
+
+			size_t height = subgrid_height(row * topology.first, topology.second, topology.first, header.height);
+			band[b].resize(header.width, height);
+			for(size_t y = 0; y < height; y++)
+			{
+				for(size_t x = 0; x < header.width; x++)
+				{
+					if(!in.good())
+						ok = 0;
+					if(ok)
+						in >> band[b][y][x];
+				}
+			}
+
+			for(size_t column = 0; column < topology.first; column++)
+			{
+				size_t index = (row * topology.first) + column;
+				Region_t region = subgrid_region(index, topology, board_size);
+				bool *part = band[b][region.y_start - y_start] + region.x_start;
+				if(index == 0)
+				{
+					for(size_t y = 0; y < region.height; y++)
+					{
+						std::copy(part + (y * band[b].stride()), part + (y * band[b].stride()) + region.width,
+							origin + (y * local_board.stride()));
+					}
+					continue;
+				}
+
+				MPI_Datatype type;
+				MPI_Type_vector(region.height, region.width, band[b].stride(), MPI_CHAR, &type);
+				MPI_Type_commit(&type);
+				requests[b].push_back(MPI_REQUEST_NULL);
+				MPI_Isend(part, 1, type, index, 0, parts, &requests[b].back());
+				MPI_Type_free(&type);
+			}
+			y_start += height;
+		}
+
+		for(int b = 0; b < 2; b++)
+		{
+			MPI_Waitall(requests[b].size(), requests[b].empty() ? NULL : &requests[b][0], MPI_STATUSES_IGNORE);
+		}
+	}
+	MPI_Type_free(&owned);
+	MPI_Comm_free(&parts);
+
+	// A short file is only found out after the parts are sent
+	MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+	return ok;
+}
+
+void place_processors(const LifeOptions_t &options, MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+	int32_t local_rank;
+	MPI_Comm node;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	// Processors that share a node take its cores in rank order
+	MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+	MPI_Comm_rank(node, &local_rank);
+	MPI_Comm_free(&node);
+
+	if(options.pin)
+		pin_thread(local_rank);
+	if(options.numa == NUMA_INTERLEAVE)
+		interleave_memory();
+	if(!options.pin && options.numa == NUMA_DEFAULT)
+		return;
+
+	// Collect a line from each processor
+	char host[MPI_MAX_PROCESSOR_NAME];
+	int length;
+	MPI_Get_processor_name(host, &length);
+	int core = current_core();
+
+	std::stringstream ss;
+	ss << "Rank " << rank << " on " << host << " cpu " << core << " (node " << node_of(core) << ")"
+		<< (options.pin ? "" : ", unpinned");
+	std::string line = ss.str();
+
+	int32_t count = line.size();
+	std::vector<int32_t> counts(size);
+	std::vector<int32_t> displs(size);
+	MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, comm);
+
+	size_t total = 0;
+	for(int32_t p = 0; p < size; p++)
+	{
+		displs[p] = total;
+		total += counts[p];
+	}
+
+	std::vector<char> lines(total + 1);
+	MPI_Gatherv(&line[0], count, MPI_CHAR, &lines[0], &counts[0], &displs[0], MPI_CHAR, 0, comm);
+
+	if(rank == 0)
+	{
+		static const char *policies[] = {"default", "first-touch", "interleave"};
+		std::cout << "Memory policy " << policies[options.numa] << " on "
+			<< numa_nodes() << " NUMA node(s)" << std::endl;
+		for(int32_t p = 0; p < size; p++)
+		{
+			std::cout << std::string(&lines[displs[p]], counts[p]) << std::endl;
+		}
+	}
+}
+
+bool generate_board(
+	LifeBoard &local_board,
+	LifeHeader_t &header,
+	size_t &margin,
+	const LifeOptions_t &options,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	header = options.generated;
+	if(header.width == 0 || header.height == 0)
+		return false;
+	std::pair<size_t, size_t> board_size = std::make_pair(header.width, header.height);
+	std::pair<size_t, size_t> topology = calculate_topology(size, board_size);
+	margin = clamp_margin(margin, header, topology);
+
+	// Fill the owned cells inside the margin
+	Region_t mine = subgrid_region(rank, topology, board_size);
+	local_board.resize(mine.width + (2 * margin), mine.height + (2 * margin));
+	Region_t owned = {margin, margin, mine.width, mine.height};
+	generate_region(local_board, owned, mine.x_start, mine.y_start, options);
+
+	return true;
+}
+
+bool gather_board(
+	std::ostream &out,
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	std::pair<size_t, size_t> board_size = std::make_pair(header.width, header.height);
+	std::pair<size_t, size_t> topology = calculate_topology(size, board_size);
+	Region_t mine = subgrid_region(rank, topology, board_size);
+
+	// Halo receives match any tag, so the parts travel on a communicator of
+	// their own in case a neighbor is still advancing
+	MPI_Comm parts;
+	MPI_Comm_dup(comm, &parts);
+
+	// The owned cells, sent straight from the local board
+	if(rank != 0)
+	{
+		MPI_Datatype owned;
+		MPI_Type_vector(mine.height, mine.width, local_board.stride(), MPI_CHAR, &owned);
+		MPI_Type_commit(&owned);
+		MPI_Send(const_cast<bool *>(local_board[margin] + margin), 1, owned, 0, 0, parts);
+		MPI_Type_free(&owned);
+		MPI_Comm_free(&parts);
+		return true;
+	}
+
+	// Receive one processor row's band at a time, the next band arriving
+	// while this one is written
+	LifeBoard band[2];
+	std::vector<MPI_Request> requests[2];
+	bool result = true;
+	for(size_t row = 0; row <= topology.second; row++)
+	{
+		if(row < topology.second)
+		{
+			const int b = row & 1;
+			size_t height = subgrid_height(row * topology.first, topology.second, topology.first, header.height);
+			band[b].resize(header.width, height);
+			for(size_t column = 0; column < topology.first; column++)
+			{
+				size_t index = (row * topology.first) + column;
+				Region_t region = subgrid_region(index, topology, board_size);
+				bool *part = band[b][0] + region.x_start;
+				if(index == 0)
+				{
+					for(size_t y = 0; y < region.height; y++)
+					{
+						std::copy(local_board[margin + y] + margin, local_board[margin + y] + margin + region.width,
+							part + (y * band[b].stride()));
+					}
+					continue;
+				}
+
+				MPI_Datatype type;
+				MPI_Type_vector(region.height, region.width, band[b].stride(), MPI_CHAR, &type);
+				MPI_Type_commit(&type);
+				requests[b].push_back(MPI_REQUEST_NULL);
+				MPI_Irecv(part, 1, type, index, 0, parts, &requests[b].back());
+				MPI_Type_free(&type);
+			}
+		}
+
+		if(row > 0)
+		{
+			const int b = (row - 1) & 1;
+			MPI_Waitall(requests[b].size(), requests[b].empty() ? NULL : &requests[b][0], MPI_STATUSES_IGNORE);
+			requests[b].clear();
+			result = result && writeFile(out, band[b], header);
+		}
+	}
+
+	MPI_Comm_free(&parts);
+	return result;
+}
+
+std::pair<size_t, size_t> map_processor(size_t index, const std::pair<size_t, size_t> &topology)
+{
+	size_t x = index % topology.first;
+	size_t y = index / topology.first;
+	return std::pair<size_t, size_t>(x, y);
+}
+
+size_t subgrid_width(size_t index, size_t columns, size_t board_width)
+{
+	size_t column = index % columns;
+	if((board_width % columns) > column)
+		return (board_width / columns) + 1;
+	else
+		return (board_width / columns);
+}
+
+size_t subgrid_height(size_t index, size_t rows, size_t columns, size_t board_height)
+{
+	size_t row = index / columns;
+	if((board_height % rows) > row)
+		return (board_height / rows) + 1;
+	else
+		return (board_height / rows);
+}
+
+size_t clamp_margin(
+	size_t margin,
+	const LifeHeader_t &header,
+	const std::pair<size_t, size_t> &topology)
+{
+	// The last row and column of processors hold the smallest subgrids
+	return std::min(margin, std::max<size_t>(1, std::min(
+		header.width / topology.first,
+		header.height / topology.second) / 2));
+}
+
+Region_t subgrid_region(
+	size_t index,
+	const std::pair<size_t, size_t> &topology,
+	const std::pair<size_t, size_t> &board_size)
+{
+	std::pair<size_t, size_t> offset = calculate_offsets(
+		map_processor(index, topology),
+		topology,
+		board_size);
+	Region_t result = {
+		offset.first,
+		offset.second,
+		subgrid_width(index, topology.first, board_size.first),
+		subgrid_height(index, topology.second, topology.first, board_size.second)};
+	return result;
+}
+
+std::pair<size_t, size_t> calculate_offsets(
+	const std::pair<size_t, size_t> &loc,
+	const std::pair<size_t, size_t> &topology,
+	const std::pair<size_t, size_t> &board_size)
+{
+	std::pair<size_t, size_t> result = std::make_pair(0, 0);
+
+	// Sum subgrid heights for prior rows
+	for(size_t y = 0; y < loc.second; y++)
+	{
+		result.second += subgrid_height(y * topology.first, topology.second, topology.first, board_size.second);
+	}
+
+	// Sum subgrid widths for all prior columns
+	for(size_t x = 0; x < loc.first; x++)
+	{
+		result.first += subgrid_width(x, topology.first, board_size.first);
+	}
+
+	return result;
+}
+
+// Return the overlap of two regions; the result has no area if they are disjoint.
+static Region_t overlap(const Region_t &a, const Region_t &b)
+{
+	size_t x0 = std::max(a.x_start, b.x_start);
+	size_t y0 = std::max(a.y_start, b.y_start);
+	size_t x1 = std::min(a.x_start + a.width, b.x_start + b.width);
+	size_t y1 = std::min(a.y_start + a.height, b.y_start + b.height);
+	Region_t result = {x0, y0, (x1 > x0) ? x1 - x0 : 0, (y1 > y0) ? y1 - y0 : 0};
+	return result;
+}
+
+// Return the blocks of a window that the part of it owned by a processor
+// touches, as a region of block coordinates (empty if none).
+static Region_t touched_blocks(const Region_t &mine, const Region_t &window, size_t block)
+{
+	Region_t part = overlap(mine, window);
+	Region_t result = {0, 0, 0, 0};
+	if(part.width > 0 && part.height > 0)
+	{
+		result.x_start = (part.x_start - window.x_start) / block;
+		result.y_start = (part.y_start - window.y_start) / block;
+		result.width = ((part.x_start + part.width - 1 - window.x_start) / block) + 1 - result.x_start;
+		result.height = ((part.y_start + part.height - 1 - window.y_start) / block) + 1 - result.y_start;
+	}
+	return result;
+}
+
+bool reduce_window(
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	const Region_t &window,
+	size_t block,
+	std::vector<uint32_t> &map,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+	std::vector<uint32_t> packet;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	std::pair<size_t, size_t> board_size = std::make_pair(header.width, header.height);
+	std::pair<size_t, size_t> topology = calculate_topology(size, board_size);
+	Region_t mine = subgrid_region(rank, topology, board_size);
+	Region_t part = overlap(mine, window);
+	Region_t blocks = touched_blocks(mine, window, block);
+
+	// Count the live cells of each block we touch; blocks that straddle
+	// subgrids are completed on the root. A processor can meet the window's
+	// rows without meeting its columns, so there may be nothing to count.
+	packet.resize(blocks.width * blocks.height, 0);
+	for(size_t y = part.y_start; !packet.empty() && y < part.y_start + part.height; y++)
+	{
+		const bool *row = local_board[margin + y - mine.y_start] + margin - mine.x_start;
+		uint32_t *block_row = &packet[(((y - window.y_start) / block) - blocks.y_start) * blocks.width];
+		for(size_t x = part.x_start; x < part.x_start + part.width; x++)
+		{
+			block_row[((x - window.x_start) / block) - blocks.x_start] += row[x];
+		}
+	}
+
+	// Only processors that overlap the window contribute any data; the root
+	// works out which blocks each one sent, so the packets are only counts
+	int32_t count = packet.size();
+	std::vector<int32_t> counts(size);
+	std::vector<int32_t> displs(size);
+	MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, comm);
+
+	size_t total = 0;
+	for(int32_t p = 0; p < size; p++)
+	{
+		displs[p] = total;
+		total += counts[p];
+	}
+
+	std::vector<uint32_t> packets(total + 1);
+	packet.push_back(0);
+	MPI_Gatherv(
+		&packet[0], count, MPI_UNSIGNED,
+		&packets[0], &counts[0], &displs[0], MPI_UNSIGNED,
+		0, comm);
+
+	if(rank != 0)
+		return false;
+
+	size_t map_width = (window.width + block - 1) / block;
+	size_t map_height = (window.height + block - 1) / block;
+	map.assign(map_width * map_height, 0);
+	for(int32_t p = 0; p < size; p++)
+	{
+		if(counts[p] == 0)
+			continue;
+
+		Region_t sent = touched_blocks(subgrid_region(p, topology, board_size), window, block);
+		const uint32_t *next = &packets[displs[p]];
+		for(size_t y = 0; y < sent.height; y++)
+		{
+			for(size_t x = 0; x < sent.width; x++)
+			{
+				map[((sent.y_start + y) * map_width) + sent.x_start + x] += *next++;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool gather_window(
+	std::ostream &out,
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	const Region_t &window,
+	size_t block,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	MPI_Comm_rank(comm, &rank);
+
+	// Reduce a band of block rows at a time, so that the root holds (and each
+	// message carries) at most WINDOW_BAND_BLOCKS counts
+	size_t map_width = (window.width + block - 1) / block;
+	size_t map_height = (window.height + block - 1) / block;
+	size_t band_rows = std::max<size_t>(1, WINDOW_BAND_BLOCKS / map_width);
+	bool result = true;
+	for(size_t by = 0; by < map_height; by += band_rows)
+	{
+		size_t rows = std::min(band_rows, map_height - by);
+		Region_t band = {
+			window.x_start,
+			window.y_start + (by * block),
+			window.width,
+			std::min(rows * block, window.height - (by * block))};
+
+		std::vector<uint32_t> map;
+		if(!reduce_window(local_board, header, margin, band, block, map, comm))
+			continue;
+
+		// Same layout as writeFile; with a block of 1 the counts are the cells
+		for(size_t y = 0; result && y < rows; y++)
+		{
+			for(size_t x = 0; x < map_width; x++)
+			{
+				out << map[(y * map_width) + x];
+				out << (((x + 1) == map_width) ? '\n' : ' ');
+			}
+			result = out.good();
+		}
+	}
+
+	return (rank != 0) || result;
+}
+
+bool open_delta_log(
+	const std::string &path,
+	const LifeHeader_t &header,
+	DeltaLog_t &log,
+	MPI_Comm comm)
+{
+	int32_t rank;
+
+	MPI_Comm_rank(comm, &rank);
+
+	if(MPI_File_open(comm, const_cast<char *>(path.c_str()),
+		MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &log.file) != MPI_SUCCESS)
+		return false;
+	MPI_File_set_size(log.file, 0);
+
+	int32_t result = 1;
+	if(rank == 0)
+	{
+		std::vector<uint8_t> buffer;
+		encode_delta_header(header.width, header.height, buffer);
+		result = MPI_File_write_at(log.file, 0, &buffer[0], buffer.size(),
+			MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+	}
+	MPI_Bcast(&result, 1, MPI_INT, 0, comm);
+
+	log.offset = DELTA_HEADER_SIZE;
+	return result;
+}
+
+// Collectively write bytes at an offset of a file, as whole LARGE_BLOCK blocks
+// and then the rest, so that no count exceeds an int. Returns true on success.
+static bool write_at_all(MPI_File file, MPI_Offset offset, const uint8_t *data, size_t bytes)
+{
+	MPI_Datatype block;
+	MPI_Type_contiguous(LARGE_BLOCK, MPI_BYTE, &block);
+	MPI_Type_commit(&block);
+
+	size_t blocks = bytes / LARGE_BLOCK;
+	size_t whole = blocks * LARGE_BLOCK;
+	uint8_t *rest = (data == NULL) ? NULL : const_cast<uint8_t *>(data) + whole;
+	bool result = MPI_File_write_at_all(file, offset, const_cast<uint8_t *>(data),
+		blocks, block, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+	result = (MPI_File_write_at_all(file, offset + whole, rest,
+		bytes - whole, MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS) && result;
+
+	MPI_Type_free(&block);
+	return result;
+}
+
+bool write_deltas(
+	DeltaLog_t &log,
+	const LifeBoard &previous,
+	const LifeBoard &current,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm)
+{
+	int32_t rank;
+	int32_t size;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	std::pair<size_t, size_t> board_size = std::make_pair(header.width, header.height);
+	std::pair<size_t, size_t> topology = calculate_topology(size, board_size);
+	Region_t mine = subgrid_region(rank, topology, board_size);
+	Region_t owned = {margin, margin, mine.width, mine.height};
+
+	// The root's chunk follows the record length
+	std::vector<uint8_t> buffer;
+	if(rank == 0)
+		buffer.resize(DELTA_RECORD_SIZE);
+	encode_deltas(previous, current, owned, mine.x_start, mine.y_start, buffer);
+
+	unsigned long long length = buffer.size();
+	unsigned long long before = 0;
+	unsigned long long total = 0;
+	MPI_Exscan(&length, &before, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+	MPI_Allreduce(&length, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+	if(rank == 0)
+	{
+		before = 0;
+		unsigned long long payload = total - DELTA_RECORD_SIZE;
+		for(size_t i = 0; i < DELTA_RECORD_SIZE; i++)
+		{
+			buffer[i] = payload >> (8 * i);
+		}
+	}
+
+	int32_t result = write_at_all(log.file, log.offset + before,
+		buffer.empty() ? NULL : &buffer[0], buffer.size());
+	MPI_Allreduce(MPI_IN_PLACE, &result, 1, MPI_INT, MPI_MIN, comm);
+
+	log.offset += total;
+	return result;
+}
+
+void close_delta_log(DeltaLog_t &log)
+{
+	MPI_File_close(&log.file);
+}
@@ -0,0 +1,256 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+/*
+ *       File:           Parallel.h
+ *       Description:    Distribution of a game of life board across processors
+ *
+ */
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <mpi.h>
+#include "LifeUtil.h"
+
+class TaskGraph;
+
+// Generations between bounding box checks in unbounded mode.
+#define UNBOUNDED_INTERVAL 32
+
+// Return status enumeration.
+enum Status_t
+{
+	STATUS_SUCCESS     =  0,
+	STATUS_BAD_PARAMS  = (1 << 0),
+	STATUS_READ_ERROR  = (1 << 1),
+	STATUS_WRITE_ERROR = (1 << 2)
+};
+
+// Returns the coordinates of a processor given its index and the grid topology.
+std::pair<size_t, size_t> map_processor(size_t index, const std::pair<size_t, size_t> &topology);
+
+// Return the width of a processor's local board.
+size_t subgrid_width(size_t index, size_t columns, size_t board_width);
+
+// Return the height of a processor's local board.
+size_t subgrid_height(size_t index, size_t rows, size_t columns, size_t board_height);
+
+// Read the board and pass out the local segment with a margin of ghost cells
+// on each side. The margin is reduced if needed so that it is no more than
+// half of the smallest subgrid. The root parses one processor row's band at a
+// time and sends each part with a non-blocking send while it parses the next,
+// holding at most two bands. Returns true on success.
+bool scatter_board(
+	std::istream &in,
+	LifeBoard &local_board,
+	LifeHeader_t &header,
+	size_t &margin,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Generate the board from options.generated and the generator options, each
+// processor filling only its own segment (see generate_region), with the
+// margin treated as in scatter_board. Returns true on success.
+bool generate_board(
+	LifeBoard &local_board,
+	LifeHeader_t &header,
+	size_t &margin,
+	const LifeOptions_t &options,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Gather each processor's local segment and write it to the output stream. Returns true on success.
+bool gather_board(
+	std::ostream &out,
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Sum the live cells of each block x block tile of a window of the board on
+// the processors that overlap it, and combine them on the root into map (one
+// entry per tile, row major). Returns true on the root.
+bool reduce_window(
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	const Region_t &window,
+	size_t block,
+	std::vector<uint32_t> &map,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Gather a window of the board from the processors that overlap it and write
+// the live cell count of each block x block tile of the window, one row of
+// tiles per line. With a block of 1 this is the window in the writeFile
+// layout. Counts are reduced locally, so only partial edge tiles move twice.
+bool gather_window(
+	std::ostream &out,
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	const Region_t &window,
+	size_t block,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// A delta log shared by the processors of a communicator.
+struct DeltaLog_t
+{
+	MPI_File file;
+	MPI_Offset offset; // End of the records written so far
+};
+
+// Collectively create a delta log for the board and write its header.
+// Returns true on success (valid on every processor).
+bool open_delta_log(
+	const std::string &path,
+	const LifeHeader_t &header,
+	DeltaLog_t &log,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Append one generation's record to a delta log. Each processor encodes the
+// owned cells that differ between previous and current local boards and
+// writes its chunk at its own offset, found with a prefix sum of the chunk
+// sizes. Returns true on success (valid on every processor).
+bool write_deltas(
+	DeltaLog_t &log,
+	const LifeBoard &previous,
+	const LifeBoard &current,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Collectively close a delta log.
+void close_delta_log(DeltaLog_t &log);
+
+// Return the cells of a local board that may be alive: the owned cells and
+// the ghost cells that are on the global board.
+Region_t simulation_domain(
+	const LifeBoard &board,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Return a new task graph that advances a local board, with its halo
+// exchange set up, for simulate and for callers that keep one across calls.
+TaskGraph *create_task_graph(
+	LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	const LifeOptions_t &options,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Advance each processor's local segment the given number of generations.
+void simulate(
+	LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	size_t generations,
+	const LifeOptions_t &options,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Advance the local segments, growing or shrinking the global board every
+// UNBOUNDED_INTERVAL generations so that the live cells stay clear of its
+// edge, which makes the board behave as an unbounded universe. Returns the
+// position of the original board's top-left cell on the final board. graph
+// is the task graph bound to the local board, or NULL to create one; it is
+// replaced whenever the board is refit, and the caller deletes it.
+std::pair<int64_t, int64_t> simulate_unbounded(
+	LifeBoard &local_board,
+	LifeHeader_t &header,
+	size_t &margin,
+	size_t generations,
+	const LifeOptions_t &options,
+	TaskGraph *&graph,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Find the bounding box of the live cells on the whole board (valid on every
+// processor). Returns false if there are none.
+bool live_bounds(
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	Region_t &bounds,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Redistribute the board onto a new width x height frame whose top-left cell
+// is at (x_origin, y_origin) on the old board. Cells outside of the old board
+// are dead; cells outside of the new frame are dropped. The new local boards
+// get a margin of depth, clamped to fit the new subgrids.
+void reframe(
+	LifeBoard &local_board,
+	LifeHeader_t &header,
+	size_t &margin,
+	size_t depth,
+	int64_t x_origin,
+	int64_t y_origin,
+	size_t width,
+	size_t height,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Pin each processor to its own core of its node and apply the NUMA policy
+// of the options, then (if either was asked for) print the core and node of
+// every processor on the root. Each processor allocates and first touches its
+// own local board, so first-touch placement needs nothing more here. Must be
+// called by every processor before boards are allocated.
+void place_processors(const LifeOptions_t &options, MPI_Comm comm = MPI_COMM_WORLD);
+
+// Measure message latency and bandwidth within and between nodes, and the
+// speed of the selected kernel, and make that the topology cost model.
+void calibrate_topology_model(const LifeOptions_t &options, MPI_Comm comm = MPI_COMM_WORLD);
+
+// Generations each configuration is timed for by autotune.
+#define TUNE_GENERATIONS 16
+
+// Choose the kernel, tile size and depth for the board. A result cached in
+// options.tune_cache for this machine, board size and processor count is
+// reused; otherwise every candidate is timed for TUNE_GENERATIONS on a copy
+// of the local boards, the slowest processor's time decides, and the winner
+// is appended to the cache. The local boards are redistributed if the margin
+// changes. Must be called by every processor.
+void autotune(
+	LifeBoard &local_board,
+	LifeHeader_t &header,
+	size_t &margin,
+	LifeOptions_t &options,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Read the board size from a life file and return a communicator of the
+// processors that plan_processors picks for it. The rest get MPI_COMM_NULL.
+MPI_Comm plan_communicator(const char *path, size_t max_idle, MPI_Comm comm = MPI_COMM_WORLD);
+
+// Return a communicator of the processors that plan_processors picks for a
+// board of the given width and height. The rest get MPI_COMM_NULL.
+MPI_Comm plan_communicator(
+	const std::pair<size_t, size_t> &board,
+	size_t max_idle,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Return the number of live cells on the whole board (valid on the root processor).
+uint64_t population(const LifeBoard &local_board, size_t margin, MPI_Comm comm = MPI_COMM_WORLD);
+
+// Return the board checksum (valid on the root processor). Each processor
+// sums the hashes of its owned cells and the sums are reduced, so the result
+// matches the serial program's for any processor configuration.
+uint64_t board_checksum(
+	const LifeBoard &local_board,
+	const LifeHeader_t &header,
+	size_t margin,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+// Return the largest margin, up to the one requested, that fits in every subgrid.
+size_t clamp_margin(
+	size_t margin,
+	const LifeHeader_t &header,
+	const std::pair<size_t, size_t> &topology);
+
+// Return the region of the global board owned by a processor.
+Region_t subgrid_region(
+	size_t index,
+	const std::pair<size_t, size_t> &topology,
+	const std::pair<size_t, size_t> &board_size);
+
+// Calculate how the processor's local board maps onto the global board.
+std::pair<size_t, size_t> calculate_offsets(
+	const std::pair<size_t, size_t> &loc,
+	const std::pair<size_t, size_t> &topology,
+	const std::pair<size_t, size_t> &board_size);
+
+#endif // PARALLEL_H
@@ -0,0 +1,138 @@
+/*
+ *       File:           Placement.cpp
+ *       Description:    Implementation of thread and memory placement
+ *
+ */
+#include <cstdio>
+#include <vector>
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "Placement.h"
+
+// Memory policy of set_mempolicy (see numaif.h).
+#define POLICY_INTERLEAVE 3
+
+// Most NUMA nodes handled.
+#define MAX_NODES 64
+
+#ifdef __linux__
+// Return the cores the calling thread may run on.
+static std::vector<int> find_cores()
+{
+	std::vector<int> cores;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(sched_getaffinity(0, sizeof(set), &set) == 0)
+	{
+		for(int c = 0; c < CPU_SETSIZE; c++)
+		{
+			if(CPU_ISSET(c, &set))
+				cores.push_back(c);
+		}
+	}
+	return cores;
+}
+
+// Return the cores the process was started on. The first call must come
+// before any thread is pinned, as threads inherit the pinning of their parent.
+static const std::vector<int> &allowed_cores()
+{
+	static const std::vector<int> cores = find_cores();
+	return cores;
+}
+#endif
+
+int core_of(size_t index)
+{
+#ifdef __linux__
+	const std::vector<int> &cores = allowed_cores();
+	if(!cores.empty())
+		return cores[index % cores.size()];
+#endif
+	return -1;
+}
+
+bool pin_thread(size_t index)
+{
+#ifdef __linux__
+	int core = core_of(index);
+	if(core < 0)
+		return false;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+int current_core()
+{
+#ifdef __linux__
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+}
+
+int node_of(int core)
+{
+#ifdef __linux__
+	// The core's sysfs directory holds a link named after its node
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", core);
+	DIR *dir = opendir(path);
+	if(dir == NULL)
+		return -1;
+
+	int node = -1;
+	struct dirent *entry;
+	while(node < 0 && (entry = readdir(dir)) != NULL)
+	{
+		if(sscanf(entry->d_name, "node%d", &node) != 1)
+			node = -1;
+	}
+	closedir(dir);
+	return node;
+#else
+	(void)core;
+	return -1;
+#endif
+}
+
+size_t numa_nodes()
+{
+	size_t nodes = 0;
+#ifdef __linux__
+	char path[64];
+	for(; nodes < MAX_NODES; nodes++)
+	{
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", (int)nodes);
+		if(access(path, F_OK) != 0)
+			break;
+	}
+#endif
+	return nodes ? nodes : 1;
+}
+
+bool interleave_memory()
+{
+#ifdef __linux__
+	unsigned long mask = 0;
+	size_t nodes = numa_nodes();
+	for(size_t n = 0; n < nodes; n++)
+	{
+		mask |= 1UL << n;
+	}
+	return syscall(SYS_set_mempolicy, POLICY_INTERLEAVE, &mask, 8 * sizeof(mask)) == 0;
+#else
+	return false;
+#endif
+}
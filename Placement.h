@@ -0,0 +1,31 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+/*
+ *       File:           Placement.h
+ *       Description:    Pinning threads to cores and placing memory on NUMA nodes
+ *
+ */
+#include <cstddef>
+
+// Return the index'th of the cores the process was started on (wrapping
+// around), or -1 if they are unknown.
+int core_of(size_t index);
+
+// Pin the calling thread to core_of(index). Returns true on success.
+bool pin_thread(size_t index);
+
+// Return the core the calling thread is running on, or -1 if unknown.
+int current_core();
+
+// Return the NUMA node of a core, or -1 if unknown.
+int node_of(int core);
+
+// Return the number of NUMA nodes (at least 1).
+size_t numa_nodes();
+
+// Spread the pages of later allocations of the calling thread, and of the
+// threads it starts, round robin across every NUMA node. Returns true on
+// success.
+bool interleave_memory();
+
+#endif // PLACEMENT_H
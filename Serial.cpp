@@ -9,32 +9,252 @@
  *
  */
 #include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
 #include "LifeUtil.h"
+#include "Delta.h"
+#include "Placement.h"
+#include "Sparse.h"
+#include "Threaded.h"
+
+// Default number of generations advanced per pass over the board.
+#define DEFAULT_DEPTH 8
+
+// Write where each worker thread runs and the memory policy.
+static void report_placement(const LifeOptions_t &options, size_t threads)
+{
+	static const char *policies[] = {"default", "first-touch", "interleave"};
+	std::cout << "Memory policy " << policies[options.numa] << " on "
+		<< numa_nodes() << " NUMA node(s)" << std::endl;
+
+	for(size_t t = 0; t < (options.pin ? threads : 1); t++)
+	{
+		int core = options.pin ? core_of(t) : current_core();
+		std::cout << "Thread " << t << " on cpu " << core << " (node " << node_of(core) << ")"
+			<< (options.pin ? "" : ", unpinned") << std::endl;
+	}
+}
+
+// Rebuild a generation from the input board and the delta log written from
+// it, and write it like a run that ended there. Returns the exit status.
+static int replay(const char *input_path, const char *output_path, const LifeOptions_t &options)
+{
+	LifeBoard board;
+	LifeHeader_t header;
+
+	std::ifstream base(input_path);
+	std::ifstream log(options.deltas.c_str(), std::ios::in | std::ios::binary);
+	if(!replay_generation(base, log, options.replay, board, header))
+		return -1;
+
+	if(options.checksum)
+	{
+		Region_t all = {0, 0, board.width(), board.height()};
+		uint64_t sum = checksum_region(board, all, 0, 0);
+		print_checksum(std::cout, options.replay, finish_checksum(sum, header.width, header.height));
+	}
+
+	std::ofstream out(output_path);
+	if(!writeFile(out, board, header))
+		return -1;
+	out.close();
+
+	return 0;
+}
+
+// Run a sparse life file on the sparse engine. Returns the exit status.
+static int run_sparse(const char *input_path, const char *output_path, const LifeOptions_t &options)
+{
+	SparseBoard board;
+	SparseHeader_t header;
+
+	std::ifstream in(input_path);
+	if(!read_sparse(in, board, header))
+		return -1;
+	in.close();
+
+	for(size_t i = 0;; i++)
+	{
+		if((options.checksum && i == header.generations) ||
+			(options.checksum_interval && (i % options.checksum_interval) == 0))
+		{
+			uint64_t sum = board.checksum_sum();
+			print_checksum(std::cout, i, finish_checksum(sum, header.width, header.height));
+		}
+
+		if(i >= header.generations)
+			break;
+		board.step();
+	}
+
+	std::vector<Cell_t> cells;
+	board.cells(cells);
+	std::ofstream out(output_path);
+	if(!write_sparse(out, cells, header))
+		return -1;
+	out.close();
+
+	return 0;
+}
 
 int main(int argc, char **argv)
 {
 	LifeHeader_t header;
+	LifeOptions_t options;
 	LifeBoard board[2];
 	bool index = false;
 
 	// Check arguments
-	if(argc < 3)
+	if(argc < 3 || !parse_options(argc, argv, options))
 		return -1;
 
-	// Read input
-	std::ifstream in(argv[1]);
-	if(!readFile(in, board[index], header))
+	// Refuse the options only the parallel program implements; a window is
+	// only written for a query
+	if((options.has_window && !options.has_query) || options.density > 1 ||
+		!options.frames.empty() || options.unbounded || options.compress ||
+		options.plan || options.max_idle > 0 || options.autotune ||
+		options.batch || options.serve)
+	{
 		return -1;
-	in.close();
+	}
+
+	// Place the threads and the memory before anything is allocated
+	size_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	if(options.pin)
+		pin_thread(0);
+	if(options.numa == NUMA_INTERLEAVE)
+		interleave_memory();
+	if(options.pin || options.numa != NUMA_DEFAULT)
+		report_placement(options, threads);
 
-	// Iterate through the generations
+	if(options.sparse)
+		return run_sparse(argv[1], argv[2], options);
+
+	// Replay a delta log rather than writing one
+	if(options.has_replay)
+	{
+		if(options.deltas.empty() || options.generate || options.has_query)
+			return -1;
+		return replay(argv[1], argv[2], options);
+	}
+
+	// Read input, or generate it
+	if(options.generate)
+	{
+		header = options.generated;
+		board[index].resize(header.width, header.height);
+		Region_t all = {0, 0, header.width, header.height};
+		generate_region(board[index], all, 0, 0, options);
+	}
+	else
+	{
+		std::ifstream in(argv[1]);
+		if(!readFile(in, board[index], header))
+			return -1;
+		in.close();
+	}
+
+	// Answer a query by stepping only the window's light cone
+	if(options.has_query)
+	{
+		Region_t window = {0, 0, board[index].width(), board[index].height()};
+		if(options.has_window)
+		{
+			window = options.window;
+			if(window.x_start >= header.width || window.y_start >= header.height)
+				return -1;
+			window.width = std::min<size_t>(window.width, header.width - window.x_start);
+			window.height = std::min<size_t>(window.height, header.height - window.y_start);
+		}
+
+		LifeBoard result;
+		query_window(board[index], window, options.query, result, options.kernel);
+		std::ofstream out(argv[2]);
+		if(!writeFile(out, result, header))
+			return -1;
+		out.close();
+		return 0;
+	}
+
+	// Log the cells that change each generation when asked
+	std::ofstream log;
+	std::vector<uint8_t> record;
+	if(!options.deltas.empty())
+	{
+		log.open(options.deltas.c_str(), std::ios::out | std::ios::binary);
+		encode_delta_header(header.width, header.height, record);
+		log.write(reinterpret_cast<const char *>(&record[0]), record.size());
+	}
+
+	// Iterate through the generations, stopping only to print checksums and
+	// to log changes (one generation at a time, so that consecutive boards
+	// can be compared)
 	Region_t region = {0, 0, board[index].width(), board[index].height()};
-	board[!index].resize(board[index].width(), board[index].height());
-	for(size_t i = 0; i < header.generations; i++)
+	size_t depth = options.depth ? options.depth : DEFAULT_DEPTH;
+	size_t steps;
+	if(options.numa == NUMA_FIRST_TOUCH && !options.tiled)
+		first_touch_threaded(board, index, threads, options.pin);
+	else
+		board[!index].resize(board[index].width(), board[index].height());
+
+	// The tiled layout keeps its own pair of boards, copied back at each stop
+	TiledLifeBoard tiled[2];
+	bool tiled_index = false;
+	if(options.tiled)
+	{
+		size_t ghost = std::min(depth, options.tile);
+		tiled[0].resize(region.width, region.height, options.tile, ghost, options.tile_order);
+		tiled[1].resize(region.width, region.height, options.tile, ghost, options.tile_order);
+		const LifeBoard &input = board[index];
+		tiled[0].copy_from(0, 0, input.view());
+	}
+	for(size_t i = 0;; i += steps)
+	{
+		if((options.checksum && i == header.generations) ||
+			(options.checksum_interval && (i % options.checksum_interval) == 0))
+		{
+			uint64_t sum = checksum_region(board[index], region, 0, 0);
+			print_checksum(std::cout, i, finish_checksum(sum, header.width, header.height));
+		}
+
+		if(i >= header.generations)
+			break;
+
+		steps = header.generations - i;
+		if(options.checksum_interval)
+			steps = std::min<size_t>(steps, options.checksum_interval - (i % options.checksum_interval));
+		if(log.is_open())
+			steps = 1;
+		if(options.tiled)
+		{
+			step_tiled_board(tiled, tiled_index, steps, depth, options.kernel);
+			tiled[tiled_index].copy_to(0, 0, board[!index].view());
+			index = !index;
+		}
+		else
+		{
+			step_board_threaded(region, board, index, steps, depth, options.tile, options.kernel, threads, options.pin);
+		}
+
+		if(log.is_open())
+		{
+			record.assign(DELTA_RECORD_SIZE, 0);
+			encode_deltas(board[!index], board[index], region, 0, 0, record);
+			for(size_t b = 0; b < DELTA_RECORD_SIZE; b++)
+			{
+				record[b] = (uint64_t)(record.size() - DELTA_RECORD_SIZE) >> (8 * b);
+			}
+			log.write(reinterpret_cast<const char *>(&record[0]), record.size());
+		}
+	}
+
+	if(log.is_open())
 	{
-		step_region(region, board[index], board[!index]);
-		index = !index;
-	} 
+		log.close();
+		if(!log)
+			return -1;
+	}
 
 	// Write output
 	std::ofstream out(argv[2]);
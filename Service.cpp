@@ -0,0 +1,335 @@
+/*
+ *       File:           Service.cpp
+ *       Description:    Implementation of the service mode
+ *
+ */
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Service.h"
+#include "TaskGraph.h"
+
+// Most generations a single step request may advance.
+#define SERVICE_MAX_STEP 1000000000LL
+
+// A board held between requests.
+struct Resident_t
+{
+	LifeBoard board;
+	LifeHeader_t header;
+	size_t margin;
+	size_t generation; // Generations advanced since the board was loaded
+	TaskGraph *graph;  // Bound to board, or NULL if none is loaded
+};
+
+// Processor 0's end of the socket.
+struct Listener_t
+{
+	int server;         // Listening socket
+	int client;         // Connected client, or -1
+	std::string buffer; // Bytes received past the last full line
+};
+
+// Return true if nothing but a socket is at path, so it is safe to unlink.
+static bool socket_or_free(const char *path)
+{
+	struct stat status;
+	return (lstat(path, &status) != 0) ? (errno == ENOENT) : S_ISSOCK(status.st_mode);
+}
+
+// Create the listening socket, replacing a stale socket but nothing else at
+// path. Returns true on success.
+static bool listen_socket(const char *path, Listener_t &listener)
+{
+	struct sockaddr_un address;
+	if(strlen(path) >= sizeof(address.sun_path))
+		return false;
+	if(!socket_or_free(path))
+	{
+		std::cerr << path << ": path exists and is not a socket" << std::endl;
+		return false;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	listener.client = -1;
+	listener.server = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener.server < 0)
+		return false;
+
+	unlink(path);
+	if(bind(listener.server, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+		listen(listener.server, 4) != 0)
+	{
+		close(listener.server);
+		return false;
+	}
+
+	return true;
+}
+
+// Wait for the next request line, accepting clients as needed. Returns
+// "shutdown" if the socket can no longer accept clients.
+static std::string next_request(Listener_t &listener)
+{
+	for(;;)
+	{
+		size_t end = listener.buffer.find('\n');
+		if(end != std::string::npos)
+		{
+			std::string line = listener.buffer.substr(0, end);
+			listener.buffer.erase(0, end + 1);
+			if(!line.empty() && line[line.size() - 1] == '\r')
+				line.erase(line.size() - 1);
+			return line;
+		}
+
+		if(listener.client < 0)
+		{
+			listener.client = accept(listener.server, NULL, NULL);
+			listener.buffer.clear();
+			if(listener.client < 0)
+			{
+				// Out of descriptors or memory: wait for some to be freed
+				if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+					sleep(1);
+				else if(errno != EINTR && errno != ECONNABORTED)
+					return "shutdown";
+			}
+			continue;
+		}
+
+		char chunk[4096];
+		ssize_t count = recv(listener.client, chunk, sizeof(chunk), 0);
+		if(count <= 0)
+		{
+			close(listener.client);
+			listener.client = -1;
+			continue;
+		}
+		listener.buffer.append(chunk, count);
+	}
+}
+
+// Send an answer to the client, if it is still connected.
+static void reply(Listener_t &listener, const std::string &answer)
+{
+	size_t sent = 0;
+	while(listener.client >= 0 && sent < answer.size())
+	{
+		ssize_t count = send(listener.client, answer.data() + sent, answer.size() - sent, MSG_NOSIGNAL);
+		if(count <= 0)
+		{
+			close(listener.client);
+			listener.client = -1;
+			break;
+		}
+		sent += count;
+	}
+}
+
+// Pass a request from processor 0 to every processor.
+static void broadcast_request(std::string &request, MPI_Comm comm)
+{
+	unsigned long long length = request.size();
+	MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG_LONG, 0, comm);
+	request.resize(length);
+	if(length > 0)
+		MPI_Bcast(&request[0], length, MPI_CHAR, 0, comm);
+}
+
+// Replace the resident board with the one in a file.
+static bool load(Resident_t &resident, const std::string &path, const LifeOptions_t &options, MPI_Comm comm)
+{
+	// Keep the resident board until the new one has been read
+	LifeBoard board;
+	LifeHeader_t header;
+	size_t margin = options.depth ? options.depth : 1;
+	std::ifstream in(path.c_str());
+	if(!scatter_board(in, board, header, margin, comm))
+		return false;
+
+	delete resident.graph;
+	resident.graph = NULL;
+	resident.board.swap(board);
+	resident.header = header;
+	resident.margin = margin;
+
+	resident.graph = create_task_graph(resident.board, resident.header, resident.margin, options, comm);
+	resident.generation = 0;
+	return true;
+}
+
+// Carry out one request on every processor and return processor 0's answer.
+// Sets done on a shutdown request.
+static std::string serve(
+	Resident_t &resident,
+	const std::string &request,
+	const LifeOptions_t &options,
+	bool &done,
+	MPI_Comm comm)
+{
+	std::stringstream in(request);
+	std::stringstream out;
+	std::string command;
+	in >> command;
+
+	if(command == "shutdown")
+	{
+		done = true;
+		return "ok\n";
+	}
+	if(command == "load")
+	{
+		std::string path;
+		if(!(in >> path))
+			return "error usage: load <file>\n";
+		if(!load(resident, path, options, comm))
+			return "error cannot read " + path + "\n";
+
+		out << "ok " << resident.header.height << " " << resident.header.width << "\n";
+		return out.str();
+	}
+	if(resident.graph == NULL)
+		return "error no board is loaded\n";
+
+	if(command == "step")
+	{
+		long long generations;
+		if(!(in >> generations) || generations < 0)
+			return "error usage: step <n>\n";
+		if(generations > SERVICE_MAX_STEP)
+		{
+			out << "error at most " << SERVICE_MAX_STEP << " generations per step\n";
+			return out.str();
+		}
+
+		double start = MPI_Wtime();
+		if(generations > 0)
+			resident.graph->run(generations);
+		resident.generation += generations;
+
+		out << "ok generation " << resident.generation << " in " << (MPI_Wtime() - start) << "s\n";
+		return out.str();
+	}
+	if(command == "query")
+	{
+		unsigned long values[4];
+		char separator[3];
+		size_t block = 1;
+		if(!(in >> values[0] >> separator[0] >> values[1] >> separator[1] >>
+			values[2] >> separator[2] >> values[3]) ||
+			separator[0] != ',' || separator[1] != ',' || separator[2] != ',' ||
+			values[2] == 0 || values[3] == 0)
+		{
+			return "error usage: query <x>,<y>,<w>,<h> [<k>]\n";
+		}
+		if(!(in >> block))
+			block = 1;
+		if(block == 0 || values[0] >= resident.header.width || values[1] >= resident.header.height)
+			return "error window is outside of the board\n";
+
+		// Clip the window to the board
+		Region_t window = {values[0], values[1], values[2], values[3]};
+		window.width = std::min<size_t>(window.width, resident.header.width - window.x_start);
+		window.height = std::min<size_t>(window.height, resident.header.height - window.y_start);
+
+		gather_window(out, resident.board, resident.header, resident.margin, window, block, comm);
+		out << "ok\n";
+		return out.str();
+	}
+	if(command == "stats")
+	{
+		uint64_t live = population(resident.board, resident.margin, comm);
+		uint64_t checksum = board_checksum(resident.board, resident.header, resident.margin, comm);
+
+		out << "ok height " << resident.header.height << " width " << resident.header.width
+			<< " generation " << resident.generation << " population " << live
+			<< " checksum " << std::hex << std::setw(16) << std::setfill('0') << checksum << "\n";
+		return out.str();
+	}
+	if(command == "save")
+	{
+		std::string path;
+		if(!(in >> path))
+			return "error usage: save <file>\n";
+
+		int32_t rank;
+		MPI_Comm_rank(comm, &rank);
+		std::ofstream file;
+		if(rank == 0)
+			file.open(path.c_str());
+		if(!gather_board(file, resident.board, resident.header, resident.margin, comm))
+			return "error cannot write " + path + "\n";
+		return "ok\n";
+	}
+
+	return "error unknown request " + command + "\n";
+}
+
+Status_t run_service(
+	const char *socket_path,
+	const char *log_path,
+	const LifeOptions_t &options)
+{
+	MPI_Comm comm = MPI_COMM_WORLD;
+	int32_t rank;
+	MPI_Comm_rank(comm, &rank);
+
+	// Processor 0 opens the socket; the rest only follow its requests
+	Listener_t listener;
+	std::ofstream log;
+	int ready = 1;
+	if(rank == 0)
+	{
+		ready = listen_socket(socket_path, listener);
+		log.open(log_path, std::ios::out | std::ios::app);
+	}
+	MPI_Bcast(&ready, 1, MPI_INT, 0, comm);
+	if(!ready)
+		return STATUS_BAD_PARAMS;
+
+	Resident_t resident;
+	resident.graph = NULL;
+	resident.generation = 0;
+	resident.margin = 0;
+
+	for(bool done = false; !done;)
+	{
+		std::string request;
+		if(rank == 0)
+			request = next_request(listener);
+		broadcast_request(request, comm);
+
+		std::string answer = serve(resident, request, options, done, comm);
+		if(rank == 0)
+		{
+			reply(listener, answer);
+			size_t last = answer.rfind('\n', answer.size() - 2);
+			log << request << " -> " << answer.substr((last == std::string::npos) ? 0 : last + 1) << std::flush;
+		}
+	}
+
+	delete resident.graph;
+	if(rank == 0)
+	{
+		if(listener.client >= 0)
+			close(listener.client);
+		close(listener.server);
+		if(socket_or_free(socket_path))
+			unlink(socket_path);
+	}
+
+	return STATUS_SUCCESS;
+}
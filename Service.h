@@ -0,0 +1,30 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+/*
+ *       File:           Service.h
+ *       Description:    A long running MPI job that serves requests over a socket
+ *
+ */
+#include "Parallel.h"
+
+// Serve requests from clients of a UNIX socket until told to shut down.
+//
+// Processor 0 listens on socket_path and takes one client at a time; each
+// line it sends is a request, which is passed to every processor and answered
+// with any data lines and then a line starting with "ok" or "error":
+//	load <file>		Read a board (its generation count is ignored)
+//	step <n>		Advance the board n generations (at most 10^9)
+//	query <x>,<y>,<w>,<h> [<k>] Write a window of the board, as --window
+//				and --density do
+//	stats			Report the size, generation, population and checksum
+//	save <file>		Write the board
+//	shutdown		Stop serving
+// The board, its distribution and the halo exchange set up for it stay in
+// place between requests. Each request and the last line of its answer are
+// appended to the log.
+Status_t run_service(
+	const char *socket_path,
+	const char *log_path,
+	const LifeOptions_t &options);
+
+#endif // SERVICE_H
@@ -0,0 +1,280 @@
+/*
+ *       File:           Sparse.cpp
+ *       Description:    Implementation of the sparse engine
+ *
+ */
+#include <algorithm>
+
+#include "LifeUtil.h"
+#include "Sparse.h"
+
+// Cells on each border of a chunk.
+#define ROW_TOP    0x00000000000000ffULL
+#define ROW_BOTTOM 0xff00000000000000ULL
+#define COL_LEFT   0x0101010101010101ULL
+#define COL_RIGHT  0x8080808080808080ULL
+
+SparseBoard::SparseBoard(uint64_t width, uint64_t height) :
+	_width(width),
+	_height(height)
+{
+}
+
+uint64_t SparseBoard::width() const
+{
+	return _width;
+}
+
+uint64_t SparseBoard::height() const
+{
+	return _height;
+}
+
+void SparseBoard::set(uint64_t x, uint64_t y, bool alive)
+{
+	if(x >= _width || y >= _height)
+		return;
+
+	uint64_t key = chunk_key(x / SPARSE_CHUNK, y / SPARSE_CHUNK);
+	uint64_t bit = 1ULL << (((y % SPARSE_CHUNK) * SPARSE_CHUNK) + (x % SPARSE_CHUNK));
+	if(alive)
+	{
+		_chunks[key] |= bit;
+	}
+	else
+	{
+		ChunkMap_t::iterator it = _chunks.find(key);
+		if(it != _chunks.end() && (it->second &= ~bit) == 0)
+			_chunks.erase(it);
+	}
+}
+
+bool SparseBoard::get(uint64_t x, uint64_t y) const
+{
+	if(x >= _width || y >= _height)
+		return false;
+
+	ChunkMap_t::const_iterator it = _chunks.find(chunk_key(x / SPARSE_CHUNK, y / SPARSE_CHUNK));
+	if(it == _chunks.end())
+		return false;
+	return (it->second >> (((y % SPARSE_CHUNK) * SPARSE_CHUNK) + (x % SPARSE_CHUNK))) & 1;
+}
+
+uint64_t SparseBoard::population() const
+{
+	uint64_t total = 0;
+	for(ChunkMap_t::const_iterator it = _chunks.begin(); it != _chunks.end(); ++it)
+	{
+		total += __builtin_popcountll(it->second);
+	}
+	return total;
+}
+
+ChunkMap_t &SparseBoard::chunks()
+{
+	return _chunks;
+}
+
+const ChunkMap_t &SparseBoard::chunks() const
+{
+	return _chunks;
+}
+
+void SparseBoard::step()
+{
+	std::vector<uint64_t> keys;
+	for(ChunkMap_t::const_iterator it = _chunks.begin(); it != _chunks.end(); ++it)
+	{
+		touched(it->first, it->second, keys);
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	ChunkMap_t next;
+	next.reserve(_chunks.size());
+	for(size_t i = 0; i < keys.size(); i++)
+	{
+		uint64_t bits = next_chunk(keys[i]);
+		if(bits)
+			next[keys[i]] = bits;
+	}
+	_chunks.swap(next);
+}
+
+void SparseBoard::touched(uint64_t key, uint64_t bits, std::vector<uint64_t> &keys) const
+{
+	const int64_t cx = chunk_x(key);
+	const int64_t cy = chunk_y(key);
+	const int64_t columns = (_width + SPARSE_CHUNK - 1) / SPARSE_CHUNK;
+	const int64_t rows = (_height + SPARSE_CHUNK - 1) / SPARSE_CHUNK;
+
+	// Which borders have live cells decides which neighbors can change
+	bool top = (bits & ROW_TOP) != 0;
+	bool bottom = (bits & ROW_BOTTOM) != 0;
+	bool left = (bits & COL_LEFT) != 0;
+	bool right = (bits & COL_RIGHT) != 0;
+	bool touches[3][3] = {
+		{top && left && (bits & 1ULL),         top,  top && right && (bits & (1ULL << 7))},
+		{left,                                 true, right},
+		{bottom && left && (bits & (1ULL << 56)), bottom, bottom && right && (bits & (1ULL << 63))}};
+
+	for(int64_t dy = -1; dy <= 1; dy++)
+	{
+		for(int64_t dx = -1; dx <= 1; dx++)
+		{
+			int64_t x = cx + dx;
+			int64_t y = cy + dy;
+			if(touches[dy + 1][dx + 1] && x >= 0 && y >= 0 && x < columns && y < rows)
+				keys.push_back(chunk_key(x, y));
+		}
+	}
+}
+
+uint64_t SparseBoard::next_chunk(uint64_t key, const ChunkMap_t *ghosts) const
+{
+	const int64_t cx = chunk_x(key);
+	const int64_t cy = chunk_y(key);
+
+	// The 3x3 block of chunks around this one
+	uint64_t around[3][3];
+	for(int64_t dy = -1; dy <= 1; dy++)
+	{
+		for(int64_t dx = -1; dx <= 1; dx++)
+		{
+			uint64_t bits = 0;
+			if(cx + dx >= 0 && cy + dy >= 0)
+			{
+				uint64_t k = chunk_key(cx + dx, cy + dy);
+				ChunkMap_t::const_iterator it = _chunks.find(k);
+				if(it != _chunks.end())
+				{
+					bits = it->second;
+				}
+				else if(ghosts != NULL)
+				{
+					it = ghosts->find(k);
+					if(it != ghosts->end())
+						bits = it->second;
+				}
+			}
+			around[dy + 1][dx + 1] = bits;
+		}
+	}
+
+	// Rows -1 to 8 of the chunk, widened by a column on each side: bit 0 is
+	// column -1, bits 1 to 8 the chunk and bit 9 column 8
+	uint32_t rows[SPARSE_CHUNK + 2];
+	for(int y = -1; y <= SPARSE_CHUNK; y++)
+	{
+		int band = (y < 0) ? 0 : ((y >= SPARSE_CHUNK) ? 2 : 1);
+		int row = (y + SPARSE_CHUNK) % SPARSE_CHUNK;
+		uint32_t left = (around[band][0] >> ((row * SPARSE_CHUNK) + 7)) & 1;
+		uint32_t center = (around[band][1] >> (row * SPARSE_CHUNK)) & 0xff;
+		uint32_t right = (around[band][2] >> (row * SPARSE_CHUNK)) & 1;
+		rows[y + 1] = left | (center << 1) | (right << 9);
+	}
+
+	uint64_t result = 0;
+	for(int y = 0; y < SPARSE_CHUNK; y++)
+	{
+		uint32_t above = rows[y];
+		uint32_t here = rows[y + 1];
+		uint32_t below = rows[y + 2];
+		for(int x = 0; x < SPARSE_CHUNK; x++)
+		{
+			int count =
+				__builtin_popcount((above >> x) & 7) +
+				__builtin_popcount((below >> x) & 7) +
+				((here >> x) & 1) + ((here >> (x + 2)) & 1);
+			bool alive = (here >> (x + 1)) & 1;
+			if(count == 3 || (alive && count == 2))
+				result |= 1ULL << ((y * SPARSE_CHUNK) + x);
+		}
+	}
+
+	return result & board_mask(key);
+}
+
+uint64_t SparseBoard::board_mask(uint64_t key) const
+{
+	uint64_t x0 = chunk_x(key) * SPARSE_CHUNK;
+	uint64_t y0 = chunk_y(key) * SPARSE_CHUNK;
+	uint64_t columns = std::min<uint64_t>(SPARSE_CHUNK, _width - x0);
+	uint64_t rows = std::min<uint64_t>(SPARSE_CHUNK, _height - y0);
+
+	uint64_t row = (1ULL << columns) - 1; // columns is at most SPARSE_CHUNK
+	uint64_t mask = 0;
+	for(uint64_t y = 0; y < rows; y++)
+	{
+		mask |= row << (y * SPARSE_CHUNK);
+	}
+	return mask;
+}
+
+void SparseBoard::cells(std::vector<Cell_t> &out) const
+{
+	for(ChunkMap_t::const_iterator it = _chunks.begin(); it != _chunks.end(); ++it)
+	{
+		uint64_t x0 = chunk_x(it->first) * SPARSE_CHUNK;
+		uint64_t y0 = chunk_y(it->first) * SPARSE_CHUNK;
+		for(uint64_t bits = it->second; bits; bits &= bits - 1)
+		{
+			int bit = __builtin_ctzll(bits);
+			out.push_back(Cell_t(x0 + (bit % SPARSE_CHUNK), y0 + (bit / SPARSE_CHUNK)));
+		}
+	}
+}
+
+uint64_t SparseBoard::checksum_sum() const
+{
+	std::vector<Cell_t> live;
+	cells(live);
+
+	uint64_t sum = 0;
+	for(size_t i = 0; i < live.size(); i++)
+	{
+		sum += checksum_cell(live[i].first, live[i].second);
+	}
+	return sum;
+}
+
+// Order cells by row, then column.
+static bool row_order(const Cell_t &a, const Cell_t &b)
+{
+	return (a.second != b.second) ? (a.second < b.second) : (a.first < b.first);
+}
+
+bool read_sparse(std::istream &in, SparseBoard &board, SparseHeader_t &header)
+{
+	if(!(in >> header.height >> header.width >> header.generations))
+		return false;
+	if(header.width == 0 || header.height == 0 ||
+		header.width > SPARSE_MAX_SIDE || header.height > SPARSE_MAX_SIDE)
+		return false;
+
+	board = SparseBoard(header.width, header.height);
+	uint64_t x;
+	uint64_t y;
+	while(in >> y >> x)
+	{
+		if(x >= header.width || y >= header.height)
+			return false;
+		board.set(x, y, true);
+	}
+
+	return in.eof();
+}
+
+bool write_sparse(std::ostream &out, std::vector<Cell_t> &cells, const SparseHeader_t &header)
+{
+	std::sort(cells.begin(), cells.end(), row_order);
+
+	out << header.height << " " << header.width << " " << header.generations << "\n";
+	for(size_t i = 0; i < cells.size(); i++)
+	{
+		if(!out.good()) return false;
+		out << cells[i].second << " " << cells[i].first << "\n";
+	}
+
+	return out.good();
+}
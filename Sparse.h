@@ -0,0 +1,110 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+/*
+ *       File:           Sparse.h
+ *       Description:    A game of life engine whose cost follows the population
+ *
+ */
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+// Edge length of a chunk. A chunk is one 64-bit word: bit (y * 8) + x is the
+// cell at (x, y) within it.
+#define SPARSE_CHUNK 8
+
+// Largest number of cells on a side of a sparse board. Chunk coordinates then
+// still fit in the 32-bit halves of a chunk key.
+#define SPARSE_MAX_SIDE (1ULL << 32)
+
+// Occupied chunks, keyed by chunk coordinates (see chunk_key).
+typedef std::unordered_map<uint64_t, uint64_t> ChunkMap_t;
+
+// A live cell's coordinates.
+typedef std::pair<uint64_t, uint64_t> Cell_t;
+
+// Header information from a sparse life file.
+struct SparseHeader_t
+{
+	uint64_t width;  // At most SPARSE_MAX_SIDE
+	uint64_t height; // At most SPARSE_MAX_SIDE
+	uint64_t generations;
+};
+
+// Return the key of the chunk at chunk coordinates (cx, cy).
+inline uint64_t chunk_key(uint64_t cx, uint64_t cy)
+{
+	return (cy << 32) | cx;
+}
+
+// Return the chunk coordinates of a key.
+inline uint64_t chunk_x(uint64_t key) { return key & 0xffffffffULL; }
+inline uint64_t chunk_y(uint64_t key) { return key >> 32; }
+
+// A board of up to 2^32 cells on a side that stores only the chunks with
+// live cells. A generation visits the occupied chunks and the neighbors their
+// border cells touch, so memory and time scale with the population rather
+// than the area. Cells outside of the board are dead.
+class SparseBoard
+{
+public:
+	// Construct an empty board of the given size.
+	SparseBoard(uint64_t width = SPARSE_MAX_SIDE, uint64_t height = SPARSE_MAX_SIDE);
+
+	// Return the number of columns.
+	uint64_t width() const;
+
+	// Return the number of rows.
+	uint64_t height() const;
+
+	// Set or clear a cell. Coordinates outside of the board are ignored.
+	void set(uint64_t x, uint64_t y, bool alive);
+
+	// Return the state of a cell.
+	bool get(uint64_t x, uint64_t y) const;
+
+	// Return the number of live cells.
+	uint64_t population() const;
+
+	// Return the occupied chunks.
+	ChunkMap_t &chunks();
+	const ChunkMap_t &chunks() const;
+
+	// Advance the board one generation.
+	void step();
+
+	// Add the chunk and the neighbors that its border cells touch to keys.
+	void touched(uint64_t key, uint64_t bits, std::vector<uint64_t> &keys) const;
+
+	// Return the next state of a chunk, reading its neighborhood from chunks
+	// and then (if given) from ghosts.
+	uint64_t next_chunk(uint64_t key, const ChunkMap_t *ghosts = NULL) const;
+
+	// Append the live cells, in no particular order.
+	void cells(std::vector<Cell_t> &out) const;
+
+	// Return the sum of checksum_cell over the live cells.
+	uint64_t checksum_sum() const;
+
+private:
+	// Return the mask of the cells of a chunk that are on the board.
+	uint64_t board_mask(uint64_t key) const;
+
+	uint64_t _width;
+	uint64_t _height;
+	ChunkMap_t _chunks;
+};
+
+// Read a sparse life file: a "height width generations" header, as in a life
+// file, with sides of at most SPARSE_MAX_SIDE, followed by a "row column" line
+// per live cell. Returns true on success.
+bool read_sparse(std::istream &in, SparseBoard &board, SparseHeader_t &header);
+
+// Write a sparse life file with the cells sorted by row, then column.
+// Returns true on success.
+bool write_sparse(std::ostream &out, std::vector<Cell_t> &cells, const SparseHeader_t &header);
+
+#endif // SPARSE_H
@@ -0,0 +1,252 @@
+/*
+ *       File:           SparseParallel.cpp
+ *       Description:    Implementation of the parallel sparse engine
+ *
+ */
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "SparseParallel.h"
+
+int32_t sparse_owner(uint64_t key, int32_t size)
+{
+	uint64_t block = chunk_key(chunk_x(key) / SPARSE_BLOCK, chunk_y(key) / SPARSE_BLOCK);
+	return (int32_t)(checksum_cell(chunk_x(block), chunk_y(block)) % (uint64_t)size);
+}
+
+// Send the (key, bits) pairs bucketed by destination processor and collect
+// the pairs received in incoming.
+static void exchange_chunks(
+	const std::vector<std::vector<uint64_t> > &outgoing,
+	ChunkMap_t &incoming,
+	MPI_Comm comm)
+{
+	int32_t size;
+	MPI_Comm_size(comm, &size);
+
+	std::vector<int> send_counts(size);
+	std::vector<int> send_displs(size);
+	std::vector<uint64_t> send_buffer;
+	for(int32_t p = 0; p < size; p++)
+	{
+		send_counts[p] = outgoing[p].size();
+		send_displs[p] = send_buffer.size();
+		send_buffer.insert(send_buffer.end(), outgoing[p].begin(), outgoing[p].end());
+	}
+
+	std::vector<int> recv_counts(size);
+	std::vector<int> recv_displs(size);
+	MPI_Alltoall(&send_counts[0], 1, MPI_INT, &recv_counts[0], 1, MPI_INT, comm);
+	size_t total = 0;
+	for(int32_t p = 0; p < size; p++)
+	{
+		recv_displs[p] = total;
+		total += recv_counts[p];
+	}
+
+	std::vector<uint64_t> recv_buffer(total + 1);
+	send_buffer.push_back(0);
+	MPI_Alltoallv(
+		&send_buffer[0], &send_counts[0], &send_displs[0], MPI_UINT64_T,
+		&recv_buffer[0], &recv_counts[0], &recv_displs[0], MPI_UINT64_T, comm);
+
+	incoming.clear();
+	incoming.reserve(total / 2);
+	for(size_t i = 0; i + 1 < total; i += 2)
+	{
+		incoming[recv_buffer[i]] = recv_buffer[i + 1];
+	}
+}
+
+// Advance the owned chunks of a board one generation.
+static void step_sparse(SparseBoard &board, int32_t rank, int32_t size, MPI_Comm comm)
+{
+	ChunkMap_t &chunks = board.chunks();
+
+	// Send each chunk to the other owners of the chunks its border touches
+	std::vector<std::vector<uint64_t> > outgoing(size);
+	std::vector<uint64_t> keys;
+	std::vector<uint64_t> candidates;
+	for(ChunkMap_t::const_iterator it = chunks.begin(); it != chunks.end(); ++it)
+	{
+		keys.clear();
+		board.touched(it->first, it->second, keys);
+
+		int32_t sent[9];
+		size_t destinations = 0;
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			int32_t owner = sparse_owner(keys[i], size);
+			if(owner == rank)
+			{
+				candidates.push_back(keys[i]);
+			}
+			else if(std::find(sent, sent + destinations, owner) == sent + destinations)
+			{
+				sent[destinations++] = owner;
+				outgoing[owner].push_back(it->first);
+				outgoing[owner].push_back(it->second);
+			}
+		}
+	}
+
+	ChunkMap_t ghosts;
+	exchange_chunks(outgoing, ghosts, comm);
+
+	// Received chunks may touch owned chunks that have no live cells yet
+	for(ChunkMap_t::const_iterator it = ghosts.begin(); it != ghosts.end(); ++it)
+	{
+		keys.clear();
+		board.touched(it->first, it->second, keys);
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			if(sparse_owner(keys[i], size) == rank)
+				candidates.push_back(keys[i]);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	ChunkMap_t next;
+	next.reserve(chunks.size());
+	for(size_t i = 0; i < candidates.size(); i++)
+	{
+		uint64_t bits = board.next_chunk(candidates[i], &ghosts);
+		if(bits)
+			next[candidates[i]] = bits;
+	}
+	chunks.swap(next);
+}
+
+// Return the board checksum (valid on the root processor).
+static uint64_t sparse_checksum(const SparseBoard &board, MPI_Comm comm)
+{
+	uint64_t local = board.checksum_sum();
+	uint64_t sum = 0;
+	MPI_Reduce(&local, &sum, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+	return finish_checksum(sum, board.width(), board.height());
+}
+
+Status_t run_sparse(
+	const char *input_path,
+	const char *output_path,
+	const LifeOptions_t &options,
+	MPI_Comm comm)
+{
+	int32_t size;
+	int32_t rank;
+	MPI_Comm_size(comm, &size);
+	MPI_Comm_rank(comm, &rank);
+
+	// Read the cells on the root and deal the chunks out to their owners
+	SparseBoard input;
+	SparseHeader_t header = {0, 0, 0};
+	std::vector<int> counts(size);
+	std::vector<int> displs(size);
+	std::vector<uint64_t> buffer(1);
+	if(rank == 0)
+	{
+		std::ifstream in(input_path);
+		if(read_sparse(in, input, header))
+		{
+			std::vector<std::vector<uint64_t> > outgoing(size);
+			const ChunkMap_t &chunks = input.chunks();
+			for(ChunkMap_t::const_iterator it = chunks.begin(); it != chunks.end(); ++it)
+			{
+				int32_t owner = sparse_owner(it->first, size);
+				outgoing[owner].push_back(it->first);
+				outgoing[owner].push_back(it->second);
+			}
+
+			buffer.clear();
+			for(int32_t p = 0; p < size; p++)
+			{
+				counts[p] = outgoing[p].size();
+				displs[p] = buffer.size();
+				buffer.insert(buffer.end(), outgoing[p].begin(), outgoing[p].end());
+			}
+			buffer.push_back(0);
+		}
+	}
+
+	uint64_t fields[3] = {header.width, header.height, header.generations};
+	MPI_Bcast(fields, 3, MPI_UINT64_T, 0, comm);
+	if(fields[0] == 0)
+		return STATUS_READ_ERROR;
+	header.width = fields[0];
+	header.height = fields[1];
+	header.generations = fields[2];
+
+	int count;
+	MPI_Scatter(&counts[0], 1, MPI_INT, &count, 1, MPI_INT, 0, comm);
+	std::vector<uint64_t> local(count + 1);
+	MPI_Scatterv(&buffer[0], &counts[0], &displs[0], MPI_UINT64_T,
+		&local[0], count, MPI_UINT64_T, 0, comm);
+	input = SparseBoard();
+
+	SparseBoard board(header.width, header.height);
+	for(int i = 0; i + 1 < count; i += 2)
+	{
+		board.chunks()[local[i]] = local[i + 1];
+	}
+
+	// Advance the board, printing checksums as requested
+	for(size_t generation = 0;; generation++)
+	{
+		if((options.checksum && generation == header.generations) ||
+			(options.checksum_interval && (generation % options.checksum_interval) == 0))
+		{
+			uint64_t checksum = sparse_checksum(board, comm);
+			if(rank == 0)
+				print_checksum(std::cout, generation, checksum);
+		}
+
+		if(generation >= header.generations)
+			break;
+		step_sparse(board, rank, size, comm);
+	}
+
+	// Gather the cells on the root and write them
+	std::vector<Cell_t> cells;
+	board.cells(cells);
+	std::vector<uint64_t> flat(2 * cells.size() + 1);
+	for(size_t i = 0; i < cells.size(); i++)
+	{
+		flat[2 * i] = cells[i].first;
+		flat[(2 * i) + 1] = cells[i].second;
+	}
+
+	count = 2 * cells.size();
+	MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, comm);
+	size_t total = 0;
+	if(rank == 0)
+	{
+		for(int32_t p = 0; p < size; p++)
+		{
+			displs[p] = total;
+			total += counts[p];
+		}
+	}
+	buffer.resize(total + 1);
+	MPI_Gatherv(&flat[0], count, MPI_UINT64_T,
+		&buffer[0], &counts[0], &displs[0], MPI_UINT64_T, 0, comm);
+
+	int status = STATUS_SUCCESS;
+	if(rank == 0)
+	{
+		cells.clear();
+		for(size_t i = 0; i + 1 < total; i += 2)
+		{
+			cells.push_back(Cell_t(buffer[i], buffer[i + 1]));
+		}
+
+		std::ofstream out(output_path);
+		if(!write_sparse(out, cells, header))
+			status = STATUS_WRITE_ERROR;
+	}
+	MPI_Bcast(&status, 1, MPI_INT, 0, comm);
+
+	return (Status_t)status;
+}
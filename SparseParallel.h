@@ -0,0 +1,32 @@
+#ifndef SPARSEPARALLEL_H
+#define SPARSEPARALLEL_H
+/*
+ *       File:           SparseParallel.h
+ *       Description:    Running the sparse engine across processors
+ *
+ */
+#include "Parallel.h"
+#include "Sparse.h"
+
+// Chunks along each side of the blocks that are dealt out to processors.
+#define SPARSE_BLOCK 8
+
+// Return the processor that owns a chunk. Square blocks of SPARSE_BLOCK
+// chunks are assigned by a hash of their position, which spreads clusters of
+// live cells over the processors while most neighbors share an owner.
+int32_t sparse_owner(uint64_t key, int32_t size);
+
+// Run a sparse life file (see read_sparse) and write the final cells.
+//
+// The root reads the file and sends each chunk to its owner. Every generation
+// each processor sends the chunks whose border cells touch a chunk owned
+// elsewhere to that chunk's owner, then advances the chunks it owns that are
+// occupied or touched. Checksums are printed as options ask; the cells are
+// gathered on the root for output.
+Status_t run_sparse(
+	const char *input_path,
+	const char *output_path,
+	const LifeOptions_t &options,
+	MPI_Comm comm = MPI_COMM_WORLD);
+
+#endif // SPARSEPARALLEL_H
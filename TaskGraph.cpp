@@ -0,0 +1,284 @@
+/*
+ *       File:           TaskGraph.cpp
+ *       Description:    Implementation of the TaskGraph class
+ *
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "TaskGraph.h"
+
+// Split length cells into pieces of at least size (the last one takes the
+// remainder) and return the start of each, followed by length.
+static std::vector<size_t> split(size_t length, size_t size)
+{
+	size_t count = std::max<size_t>(1, length / size);
+	std::vector<size_t> starts;
+	for(size_t i = 0; i < count; i++)
+	{
+		starts.push_back(i * size);
+	}
+	starts.push_back(length);
+	return starts;
+}
+
+TaskGraph::TaskGraph(
+	LifeBoard &board,
+	const Topology_t &topology,
+	size_t margin,
+	const Region_t &domain,
+	const LifeOptions_t &options,
+	MPI_Comm comm) :
+	_board(board),
+	_other(board.width(), board.height()),
+	_margin(margin),
+	_domain(domain),
+	_kernel(options.kernel),
+	_tile_size(std::max(options.tile, margin)),
+	_edge_count(0),
+	_generations(0),
+	_rounds(0),
+	_begun(0)
+{
+	_buffers[0] = &_board;
+	_buffers[1] = &_other;
+	_io[0] = new AsyncIO(_board, topology, margin, comm, options.compress);
+	_io[1] = new AsyncIO(_other, topology, margin, comm, options.compress);
+
+	// Every tile is at least margin wide, so a round only reads its neighbors
+	const size_t width = board.width() - (2 * margin);
+	const size_t height = board.height() - (2 * margin);
+	std::vector<size_t> xs = split(width, _tile_size);
+	std::vector<size_t> ys = split(height, _tile_size);
+	const size_t columns = xs.size() - 1;
+	const size_t rows = ys.size() - 1;
+
+	for(size_t j = 0; j < rows; j++)
+	{
+		for(size_t i = 0; i < columns; i++)
+		{
+			Tile_t tile;
+			Region_t region = {margin + xs[i], margin + ys[j], xs[i + 1] - xs[i], ys[j + 1] - ys[j]};
+			tile.region = region;
+			tile.rounds = 0;
+
+			bool n = (j == 0);
+			bool s = (j + 1 == rows);
+			bool w = (i == 0);
+			bool e = (i + 1 == columns);
+			tile.halos =
+				(n ? AsyncIO::HALO_N : 0) |
+				(s ? AsyncIO::HALO_S : 0) |
+				(e ? AsyncIO::HALO_E : 0) |
+				(w ? AsyncIO::HALO_W : 0) |
+				((n && w) ? AsyncIO::HALO_NW : 0) |
+				((n && e) ? AsyncIO::HALO_NE : 0) |
+				((s && e) ? AsyncIO::HALO_SE : 0) |
+				((s && w) ? AsyncIO::HALO_SW : 0);
+			if(tile.halos)
+				_edge_count++;
+
+			for(size_t y = (j ? j - 1 : 0); y <= std::min(j + 1, rows - 1); y++)
+			{
+				for(size_t x = (i ? i - 1 : 0); x <= std::min(i + 1, columns - 1); x++)
+				{
+					tile.neighbors.push_back((y * columns) + x);
+				}
+			}
+
+			_tiles.push_back(tile);
+		}
+	}
+
+	_waits[0].resize(_tiles.size());
+	_waits[1].resize(_tiles.size());
+}
+
+TaskGraph::~TaskGraph()
+{
+	delete _io[0];
+	delete _io[1];
+}
+
+void TaskGraph::run(size_t generations, bool keep_previous)
+{
+	if(generations == 0)
+		return;
+
+	_generations = generations;
+	_rounds = (generations + _margin - 1) / _margin;
+	_begun = 0;
+	_edge_done[0] = 0;
+	_edge_done[1] = 0;
+	_interior.clear();
+	_edges.clear();
+
+	for(size_t t = 0; t < _tiles.size(); t++)
+	{
+		_tiles[t].rounds = 0;
+		_waits[0][t] = _tiles[t].neighbors.size();
+		_waits[1][t] = _tiles[t].neighbors.size();
+		if(_tiles[t].halos)
+			_edges.push_back(t);
+		else
+			_interior.push_back(t);
+	}
+
+	size_t remaining = _tiles.size() * _rounds;
+	while(remaining > 0)
+	{
+		try_begin();
+
+		// Edge tiles first: the next exchange waits on them
+		bool ran = false;
+		for(size_t i = 0; i < _edges.size();)
+		{
+			if(edge_ready(_edges[i]))
+			{
+				size_t tile = _edges[i];
+				_edges.erase(_edges.begin() + i);
+				run_tile(tile);
+				remaining--;
+				ran = true;
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		// Then one interior tile, checking on the network in between
+		if(!_interior.empty())
+		{
+			size_t tile = _interior.front();
+			_interior.pop_front();
+			run_tile(tile);
+			remaining--;
+			ran = true;
+		}
+
+		if(ran)
+			progress();
+		else if(remaining > 0)
+			wait_edge();
+	}
+
+	// Finish the communication of the last rounds
+	for(size_t r = (_rounds > 2) ? (_rounds - 2) : 0; r < _rounds; r++)
+	{
+		_io[r & 1]->end();
+	}
+
+	// The result is in the buffer the last round wrote. A single round read
+	// the board, so swapping instead of copying keeps the generation before.
+	if(_rounds & 1)
+	{
+		const size_t width = _board.width() - (2 * _margin);
+		for(size_t y = _margin; y < _board.height() - _margin; y++)
+		{
+			if(keep_previous)
+				std::swap_ranges(&_board[y][_margin], &_board[y][_margin] + width, &_other[y][_margin]);
+			else
+				memcpy(&_board[y][_margin], &_other[y][_margin], width * sizeof(bool));
+		}
+	}
+}
+
+const LifeBoard &TaskGraph::previous() const
+{
+	return _other;
+}
+
+void TaskGraph::try_begin()
+{
+	if(_begun >= _rounds)
+		return;
+	if(_begun > 0 && _edge_done[(_begun - 1) & 1] < _edge_count)
+		return;
+
+	// The buffer's previous round must be done with its messages
+	AsyncIO *io = _io[_begun & 1];
+	if(_begun >= 2)
+		io->end();
+	io->begin();
+
+	// Every edge tile finished the round before last, so its counter is free
+	_edge_done[_begun & 1] = 0;
+	_begun++;
+}
+
+bool TaskGraph::edge_ready(size_t tile)
+{
+	size_t round = _tiles[tile].rounds;
+	if(round >= _begun || !_io[round & 1]->arrived(_tiles[tile].halos))
+		return false;
+
+	// The previous round's sends read the cells this round overwrites
+	return (round == 0) || _io[(round - 1) & 1]->sent();
+}
+
+void TaskGraph::run_tile(size_t tile)
+{
+	Tile_t &t = _tiles[tile];
+	size_t round = t.rounds;
+	size_t steps = std::min(_margin, _generations - (round * _margin));
+
+	step_region_temporal(
+		t.region, _domain,
+		*_buffers[round & 1], *_buffers[!(round & 1)],
+		steps, _tile_size, _scratch, _kernel);
+
+	// Edge cells go straight into the next round's column mirrors while hot
+	t.rounds++;
+	if(t.halos)
+	{
+		_io[!(round & 1)]->mirror(t.region);
+		_edge_done[round & 1]++;
+	}
+
+	// No neighbor can finish the next round before this tile is queued for
+	// it, so its counter can be rearmed for the round after here
+	size_t next = round + 1;
+	if(next >= _rounds)
+		return;
+	for(size_t i = 0; i < t.neighbors.size(); i++)
+	{
+		size_t neighbor = t.neighbors[i];
+		int &wait = _waits[next & 1][neighbor];
+		if(--wait == 0)
+		{
+			wait = _tiles[neighbor].neighbors.size();
+			if(_tiles[neighbor].halos)
+				_edges.push_back(neighbor);
+			else
+				_interior.push_back(neighbor);
+		}
+	}
+}
+
+void TaskGraph::wait_edge()
+{
+	// Nothing can run, so the oldest edge tile is waiting on the network
+	size_t oldest = _edges[0];
+	for(size_t i = 1; i < _edges.size(); i++)
+	{
+		if(_tiles[_edges[i]].rounds < _tiles[oldest].rounds)
+			oldest = _edges[i];
+	}
+
+	size_t round = _tiles[oldest].rounds;
+	if(round >= _begun)
+		return;
+	if(!_io[round & 1]->arrived(_tiles[oldest].halos))
+		_io[round & 1]->wait_some();
+	else
+		_io[(round - 1) & 1]->end();
+}
+
+void TaskGraph::progress()
+{
+	for(size_t r = (_begun > 2) ? (_begun - 2) : 0; r < _begun; r++)
+	{
+		_io[r & 1]->progress();
+	}
+}
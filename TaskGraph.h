@@ -0,0 +1,94 @@
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+/*
+ *       File:           TaskGraph.h
+ *       Description:    Dependency driven scheduling of a local board's tiles
+ *
+ */
+#include <deque>
+#include <vector>
+#include "AsyncIO.h"
+
+// Advances a local board one exchange round at a time, where a round
+// exchanges a margin deep halo and then advances up to margin generations.
+// The owned cells are cut into tiles, and each round of each tile is a task.
+// A task may run once its 3x3 block of tiles has finished the previous round
+// and, for a tile on the edge, once the halos it reads have arrived and the
+// previous round's sends (which read the cells it overwrites) are done. Tasks
+// of different rounds run side by side, so interior tiles move on to the
+// next round while edge tiles wait on the network.
+//
+// Rounds alternate between the board and a second buffer, each with its own
+// AsyncIO, so a round's halos can be posted while the last one is in flight.
+class TaskGraph
+{
+public:
+	// Bind to a local board with a margin of ghost cells. Cells outside of
+	// domain are dead. Tiles are options.tile wide (at least margin), with the
+	// remainder folded into the last row and column.
+	TaskGraph(
+		LifeBoard &board,
+		const Topology_t &topology,
+		size_t margin,
+		const Region_t &domain,
+		const LifeOptions_t &options,
+		MPI_Comm comm = MPI_COMM_WORLD);
+
+	// Dtor.
+	~TaskGraph();
+
+	// Advance the board the given number of generations. With keep_previous
+	// (which needs generations to be at most margin) the owned cells of the
+	// board as it was before the last generation are left in previous().
+	void run(size_t generations, bool keep_previous = false);
+
+	// Return the buffer holding the previous generation after a run with
+	// keep_previous. Only its owned cells are valid.
+	const LifeBoard &previous() const;
+
+private:
+	// A tile of the owned cells.
+	struct Tile_t
+	{
+		Region_t region;
+		uint32_t halos;                // Halos read by the tile, or 0 for an interior tile
+		size_t rounds;                 // Rounds finished
+		std::vector<size_t> neighbors; // Tiles of the 3x3 block, including this one
+	};
+
+	// Post the next round's halos if every edge tile is ready for it.
+	void try_begin();
+
+	// Return true if an edge tile's halos for its next round are in.
+	bool edge_ready(size_t tile);
+
+	// Run a tile's next round and release the tasks waiting on it.
+	void run_tile(size_t tile);
+
+	// Block until the oldest waiting edge tile can make progress.
+	void wait_edge();
+
+	// Drive the communication of every round in flight.
+	void progress();
+
+	LifeBoard &_board;
+	LifeBoard _other;
+	LifeBoard *_buffers[2];
+	LifeBoard _scratch[2];           // Tile buffers of step_region_temporal
+	AsyncIO *_io[2];
+	size_t _margin;
+	Region_t _domain;
+	StepKernel_t _kernel;
+	size_t _tile_size;
+	std::vector<Tile_t> _tiles;
+	std::vector<int> _waits[2];      // Unfinished neighbors per tile, for odd and even rounds
+	std::deque<size_t> _interior;    // Interior tiles ready to run
+	std::vector<size_t> _edges;      // Edge tiles waiting only on the network
+	size_t _edge_done[2];            // Edge tiles that have finished the latest odd and even rounds
+	size_t _edge_count;
+	size_t _generations;
+	size_t _rounds;
+	size_t _begun;                   // Rounds whose halos have been posted
+};
+
+#endif // TASKGRAPH_H
@@ -0,0 +1,281 @@
+/*
+ *       File:           Threaded.cpp
+ *       Description:    Implementation of the multi-threaded engine
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+
+#include "Placement.h"
+#include "Threaded.h"
+
+// One pass over one tile.
+struct TileTask_t
+{
+	size_t tile;
+	size_t pass;
+};
+
+// A deque of ready tasks. The owner works from the back, so it tends to
+// continue near the tile it just finished, and thieves take from the front.
+class WorkQueue
+{
+public:
+	// Add a task for the owner.
+	void push(const TileTask_t &task)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_tasks.push_back(task);
+	}
+
+	// Take the newest task. Returns false if there are none.
+	bool pop(TileTask_t &task)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if(_tasks.empty())
+			return false;
+		task = _tasks.back();
+		_tasks.pop_back();
+		return true;
+	}
+
+	// Take the oldest task. Returns false if there are none.
+	bool steal(TileTask_t &task)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if(_tasks.empty())
+			return false;
+		task = _tasks.front();
+		_tasks.pop_front();
+		return true;
+	}
+
+private:
+	std::mutex _mutex;
+	std::deque<TileTask_t> _tasks;
+};
+
+// State shared by the threads of one call to step_board_threaded.
+struct ThreadedRun_t
+{
+	Region_t region;
+	LifeBoard *board;
+	bool index;
+	size_t generations;
+	size_t depth;
+	size_t tile_size;
+	StepKernel_t kernel;
+	size_t columns;
+	size_t rows;
+	size_t passes;
+	size_t threads;
+	bool pin;                                  // Pin each thread to its own core
+	std::vector<int> neighbors;                // Tiles in each tile's 3x3 block
+	std::unique_ptr<std::atomic<int>[]> waits; // Unfinished neighbors per tile, for odd and even passes
+	std::unique_ptr<WorkQueue[]> queues;
+	std::unique_ptr<LifeBoard[]> scratch;      // Tile buffers of step_region_temporal, a pair per thread
+	std::atomic<size_t> remaining;             // Tasks not yet finished
+};
+
+// Return the part of the region covered by a tile.
+static Region_t tile_region(const ThreadedRun_t &run, size_t tile)
+{
+	size_t tx = run.region.x_start + ((tile % run.columns) * run.tile_size);
+	size_t ty = run.region.y_start + ((tile / run.columns) * run.tile_size);
+	Region_t result = {
+		tx,
+		ty,
+		std::min(run.tile_size, run.region.x_start + run.region.width - tx),
+		std::min(run.tile_size, run.region.y_start + run.region.height - ty)};
+	return result;
+}
+
+// Run one task, then count it against the next pass of each neighboring tile
+// and queue the ones that become ready.
+static void run_task(ThreadedRun_t &run, size_t id, const TileTask_t &task)
+{
+	bool src = run.index ^ (task.pass & 1);
+	size_t steps = std::min(run.depth, run.generations - (task.pass * run.depth));
+	step_region_temporal(
+		tile_region(run, task.tile), run.region,
+		run.board[src], run.board[!src],
+		steps, run.tile_size, &run.scratch[2 * id], run.kernel);
+
+	size_t next = task.pass + 1;
+	if(next < run.passes)
+	{
+		size_t column = task.tile % run.columns;
+		size_t row = task.tile / run.columns;
+		for(size_t y = (row ? row - 1 : 0); y <= std::min(row + 1, run.rows - 1); y++)
+		{
+			for(size_t x = (column ? column - 1 : 0); x <= std::min(column + 1, run.columns - 1); x++)
+			{
+				size_t neighbor = (y * run.columns) + x;
+				std::atomic<int> &wait = run.waits[((next & 1) * run.columns * run.rows) + neighbor];
+
+				// No neighbor can finish pass next until this one is queued,
+				// so the counter can be rearmed for pass next + 2 here
+				if(wait.fetch_sub(1) == 1)
+				{
+					wait.store(run.neighbors[neighbor]);
+					TileTask_t ready = {neighbor, next};
+					run.queues[id].push(ready);
+				}
+			}
+		}
+	}
+
+	run.remaining.fetch_sub(1);
+}
+
+// Run tasks from this thread's queue, stealing from the others when it is
+// empty, until every task is finished.
+static void work(ThreadedRun_t &run, size_t id)
+{
+	TileTask_t task;
+
+	if(run.pin && id > 0)
+		pin_thread(id);
+	while(run.remaining.load() > 0)
+	{
+		bool found = run.queues[id].pop(task);
+		for(size_t i = 1; !found && i < run.threads; i++)
+		{
+			found = run.queues[(id + i) % run.threads].steal(task);
+		}
+
+		if(found)
+			run_task(run, id, task);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void step_board_threaded(
+	const Region_t &region,
+	LifeBoard board[2],
+	bool &index,
+	size_t generations,
+	size_t depth,
+	size_t tile_size,
+	StepKernel_t kernel,
+	size_t threads,
+	bool pin)
+{
+	if(generations == 0)
+		return;
+
+	if(threads <= 1)
+	{
+		size_t steps;
+		LifeBoard scratch[2];
+		for(size_t i = 0; i < generations; i += steps)
+		{
+			steps = std::min(depth, generations - i);
+			step_region_temporal(region, region, board[index], board[!index], steps, tile_size, scratch, kernel);
+			index = !index;
+		}
+		return;
+	}
+
+	// A pass may then only read from neighboring tiles
+	depth = std::max<size_t>(1, std::min(depth, tile_size));
+
+	ThreadedRun_t run;
+	run.region = region;
+	run.board = board;
+	run.index = index;
+	run.generations = generations;
+	run.depth = depth;
+	run.tile_size = tile_size;
+	run.kernel = kernel;
+	run.columns = (region.width + tile_size - 1) / tile_size;
+	run.rows = (region.height + tile_size - 1) / tile_size;
+	run.passes = (generations + depth - 1) / depth;
+	run.threads = threads;
+	run.pin = pin;
+
+	const size_t tiles = run.columns * run.rows;
+	run.neighbors.resize(tiles);
+	run.waits.reset(new std::atomic<int>[2 * tiles]);
+	run.queues.reset(new WorkQueue[threads]);
+	run.scratch.reset(new LifeBoard[2 * threads]);
+	run.remaining.store(tiles * run.passes);
+
+	for(size_t tile = 0; tile < tiles; tile++)
+	{
+		size_t column = tile % run.columns;
+		size_t row = tile / run.columns;
+		size_t across = std::min(column + 1, run.columns - 1) - (column ? column - 1 : 0) + 1;
+		size_t down = std::min(row + 1, run.rows - 1) - (row ? row - 1 : 0) + 1;
+		run.neighbors[tile] = across * down;
+		run.waits[tile].store(run.neighbors[tile]);
+		run.waits[tiles + tile].store(run.neighbors[tile]);
+
+		// Start each thread on its own band of tiles
+		TileTask_t task = {tile, 0};
+		run.queues[(tile * threads) / tiles].push(task);
+	}
+
+	std::vector<std::thread> pool;
+	for(size_t id = 1; id < threads; id++)
+	{
+		pool.push_back(std::thread(work, std::ref(run), id));
+	}
+	work(run, 0);
+	for(size_t i = 0; i < pool.size(); i++)
+	{
+		pool[i].join();
+	}
+
+	if(run.passes & 1)
+		index = !index;
+}
+
+// Copy rows [begin, end) of src into dst and clear them in other, on thread id.
+static void touch_rows(const LifeBoard *src, LifeBoard *dst, LifeBoard *other, size_t begin, size_t end, size_t id, bool pin)
+{
+	if(pin && id > 0)
+		pin_thread(id);
+
+	const size_t width = src->width();
+	const size_t stride = dst->stride();
+	for(size_t y = begin; y < end; y++)
+	{
+		memcpy((*dst)[y], (*src)[y], width * sizeof(bool));
+		memset((*dst)[y] + width, 0, (stride - width) * sizeof(bool));
+		memset((*other)[y], 0, stride * sizeof(bool));
+	}
+}
+
+void first_touch_threaded(LifeBoard board[2], bool index, size_t threads, bool pin)
+{
+	const LifeBoard &input = board[index];
+	const size_t height = input.height();
+	threads = std::max<size_t>(1, threads);
+
+	LifeBoard fresh[2];
+	fresh[0].resize(input.width(), input.height(), 0, ARRAY2D_NO_FILL);
+	fresh[1].resize(input.width(), input.height(), 0, ARRAY2D_NO_FILL);
+
+	std::vector<std::thread> pool;
+	for(size_t id = 1; id < threads; id++)
+	{
+		pool.push_back(std::thread(touch_rows, &input, &fresh[index], &fresh[!index],
+			(id * height) / threads, ((id + 1) * height) / threads, id, pin));
+	}
+	touch_rows(&input, &fresh[index], &fresh[!index], 0, height / threads, 0, pin);
+	for(size_t i = 0; i < pool.size(); i++)
+	{
+		pool[i].join();
+	}
+
+	board[0].swap(fresh[0]);
+	board[1].swap(fresh[1]);
+}
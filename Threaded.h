@@ -0,0 +1,39 @@
+#ifndef THREADED_H
+#define THREADED_H
+/*
+ *       File:           Threaded.h
+ *       Description:    Multi-threaded engine for the serial program
+ *
+ */
+#include "LifeUtil.h"
+
+// Advance region of board[index] the given number of generations, ping-ponging
+// between board[0] and board[1] depth generations per pass; index is left
+// pointing at the result. Cells outside of region are dead.
+//
+// The region is cut into tile_size tiles, and each pass over a tile is a task
+// run on a pool of threads with one work-stealing deque each. A task is ready
+// once the previous pass over the tile and its eight neighbors is done, which
+// is tracked with a counter per tile, so threads never wait for the whole
+// board between passes. The depth is clamped to tile_size so that a pass
+// only reads from neighboring tiles. With one thread the passes run in order
+// on the calling thread. With pin, thread i runs on core_of(i).
+void step_board_threaded(
+	const Region_t &region,
+	LifeBoard board[2],
+	bool &index,
+	size_t generations,
+	size_t depth,
+	size_t tile_size,
+	StepKernel_t kernel,
+	size_t threads,
+	bool pin = false);
+
+// Reallocate board[0] and board[1] without touching their pages and have each
+// of threads threads copy in (from board[index]) and clear its own band of
+// rows, the band that step_board_threaded starts that thread on. Under the
+// default first-touch policy each band then sits on the NUMA node of the
+// thread that steps it, which with pin stays the same from call to call.
+void first_touch_threaded(LifeBoard board[2], bool index, size_t threads, bool pin = false);
+
+#endif // THREADED_H
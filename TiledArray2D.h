@@ -0,0 +1,374 @@
+#ifndef TILED_ARRAY_H
+#define TILED_ARRAY_H
+
+#include <algorithm>
+#include <vector>
+#include "Array2D.h"
+
+// Orders in which the tiles of a TiledArray2D are laid out in memory.
+enum TileOrder_t
+{
+	TILE_ROWS,    // Row-major, like Array2D
+	TILE_MORTON,  // Z-order: interleaved bits of the tile coordinates
+	TILE_HILBERT  // Hilbert curve: neighbors on the curve share an edge
+};
+
+// A 2d array stored as fixed-size square tiles, each with a border of ghost
+// elements copied from its neighbors. Tile blocks (tile + 2 * ghost elements
+// on a side, row-major inside) are laid out one after anouther along a space
+// filling curve, so a tile and its working set are compact in memory and
+// tiles near each other on the board are mostly near each other in memory.
+//
+// The blocks are stacked vertically in one Array2D, which storage() exposes:
+// block slot occupies rows [slot * span, (slot + 1) * span), so row-major code
+// can run on a tile (ghosts included) as a region of that array.
+// T must be trivially copyable; copies are done with memcpy.
+template<class T>
+class TiledArray2D
+{
+public:
+	// A tile in layout order.
+	struct Tile_t
+	{
+		size_t slot; // Position along the curve
+		size_t tx;   // Tile column
+		size_t ty;   // Tile row
+	};
+
+	// Iterates over the tiles in layout order.
+	class tile_iterator
+	{
+	public:
+		tile_iterator(const TiledArray2D *array, size_t slot) : _array(array), _slot(slot) {}
+		Tile_t operator*() const { return _array->tile_at(_slot); }
+		tile_iterator &operator++() { _slot++; return *this; }
+		bool operator!=(const tile_iterator &other) const { return _slot != other._slot; }
+		bool operator==(const tile_iterator &other) const { return _slot == other._slot; }
+
+	private:
+		const TiledArray2D *_array;
+		size_t _slot;
+	};
+
+	// Default constructor creates an invalid array. Call resize before use.
+	TiledArray2D();
+
+	// Construct a tiled array of the given size.
+	TiledArray2D(size_t width, size_t height, size_t tile, size_t ghost, TileOrder_t order = TILE_HILBERT);
+
+	// Destructively resize the array. Every element (and ghost) is zero.
+	void resize(size_t width, size_t height, size_t tile, size_t ghost, TileOrder_t order = TILE_HILBERT);
+
+	// Return the number of columns.
+	size_t width() const { return _width; }
+
+	// Return the number of rows.
+	size_t height() const { return _height; }
+
+	// Return the edge length of a tile, without ghosts.
+	size_t tile_size() const { return _tile; }
+
+	// Return the depth of the ghost border around each tile.
+	size_t ghost() const { return _ghost; }
+
+	// Return the edge length of a tile block, with ghosts.
+	size_t span() const { return _tile + (2 * _ghost); }
+
+	// Return the number of tile columns and rows.
+	size_t tiles_x() const { return _tiles_x; }
+	size_t tiles_y() const { return _tiles_y; }
+
+	// Return the number of tiles.
+	size_t tile_count() const { return _tiles_x * _tiles_y; }
+
+	// Return the layout position of a tile.
+	size_t slot(size_t tx, size_t ty) const { return _slots[(ty * _tiles_x) + tx]; }
+
+	// Return the tile at a layout position.
+	Tile_t tile_at(size_t slot) const;
+
+	// Iterate over the tiles in layout order.
+	tile_iterator begin() const { return tile_iterator(this, 0); }
+	tile_iterator end() const { return tile_iterator(this, tile_count()); }
+
+	// Return the array that holds the stacked tile blocks.
+	Array2D<T> &storage() { return _storage; }
+	const Array2D<T> &storage() const { return _storage; }
+
+	// Return a view of a tile block, ghosts included.
+	Array2DView<T> block(size_t slot) { return _storage.region(0, slot * span(), span(), span()); }
+	Array2DView<const T> block(size_t slot) const { return _storage.region(0, slot * span(), span(), span()); }
+
+	// Return a reference to an element. Bounds checked.
+	T &at(size_t x, size_t y);
+	const T &at(size_t x, size_t y) const;
+
+	// Copy a width x height region starting at (x, y) into a view of that size.
+	void copy_to(size_t x, size_t y, const Array2DView<T> &out) const;
+
+	// Copy a view into the region of its size starting at (x, y).
+	void copy_from(size_t x, size_t y, const Array2DView<const T> &in);
+
+	// Refill every ghost border from the neighboring tiles. Ghosts past the
+	// edge of the array, and elements of partial edge tiles past it, are zero.
+	void refresh_ghosts();
+
+private:
+	// Return the position of a tile on a Hilbert curve over an n x n grid.
+	static size_t hilbert_index(size_t n, size_t x, size_t y);
+
+	// Return the position of a tile on a Z-order curve.
+	static size_t morton_index(size_t x, size_t y);
+
+	// Return a pointer to the element at (x, y) of the array, which must be
+	// inside the array.
+	T *element(size_t x, size_t y);
+	const T *element(size_t x, size_t y) const;
+
+	size_t _width;
+	size_t _height;
+	size_t _tile;
+	size_t _ghost;
+	size_t _tiles_x;
+	size_t _tiles_y;
+	std::vector<size_t> _slots; // Layout position of each tile, row-major
+	std::vector<size_t> _tiles; // Tile (row-major index) at each layout position
+	Array2D<T> _storage;
+};
+
+template<class T>
+TiledArray2D<T>::TiledArray2D() :
+	_width(0),
+	_height(0),
+	_tile(0),
+	_ghost(0),
+	_tiles_x(0),
+	_tiles_y(0)
+{
+}
+
+template<class T>
+TiledArray2D<T>::TiledArray2D(size_t width, size_t height, size_t tile, size_t ghost, TileOrder_t order) :
+	_width(0),
+	_height(0),
+	_tile(0),
+	_ghost(0),
+	_tiles_x(0),
+	_tiles_y(0)
+{
+	resize(width, height, tile, ghost, order);
+}
+
+template<class T>
+void TiledArray2D<T>::resize(size_t width, size_t height, size_t tile, size_t ghost, TileOrder_t order)
+{
+	assert(width > 0);
+	assert(height > 0);
+	assert(tile > 0);
+	assert(ghost <= tile);
+
+	_width = width;
+	_height = height;
+	_tile = tile;
+	_ghost = ghost;
+	_tiles_x = (width + tile - 1) / tile;
+	_tiles_y = (height + tile - 1) / tile;
+
+	// Sort the tiles by their position on the curve
+	size_t n = 1;
+	while(n < std::max(_tiles_x, _tiles_y))
+		n *= 2;
+
+	std::vector<std::pair<size_t, size_t> > keys;
+	for(size_t ty = 0; ty < _tiles_y; ty++)
+	{
+		for(size_t tx = 0; tx < _tiles_x; tx++)
+		{
+			size_t key = (ty * _tiles_x) + tx;
+			if(order == TILE_MORTON)
+				key = morton_index(tx, ty);
+			else if(order == TILE_HILBERT)
+				key = hilbert_index(n, tx, ty);
+			keys.push_back(std::make_pair(key, (ty * _tiles_x) + tx));
+		}
+	}
+	std::sort(keys.begin(), keys.end());
+
+	_slots.resize(keys.size());
+	_tiles.resize(keys.size());
+	for(size_t slot = 0; slot < keys.size(); slot++)
+	{
+		_tiles[slot] = keys[slot].second;
+		_slots[keys[slot].second] = slot;
+	}
+
+	_storage.resize(span(), span() * tile_count());
+}
+
+template<class T>
+typename TiledArray2D<T>::Tile_t TiledArray2D<T>::tile_at(size_t slot) const
+{
+	Tile_t result = {slot, _tiles[slot] % _tiles_x, _tiles[slot] / _tiles_x};
+	return result;
+}
+
+template<class T>
+T *TiledArray2D<T>::element(size_t x, size_t y)
+{
+	size_t s = slot(x / _tile, y / _tile);
+	return &_storage[(s * span()) + _ghost + (y % _tile)][_ghost + (x % _tile)];
+}
+
+template<class T>
+const T *TiledArray2D<T>::element(size_t x, size_t y) const
+{
+	size_t s = slot(x / _tile, y / _tile);
+	return &_storage[(s * span()) + _ghost + (y % _tile)][_ghost + (x % _tile)];
+}
+
+template<class T>
+T &TiledArray2D<T>::at(size_t x, size_t y)
+{
+	assert(x < _width);
+	assert(y < _height);
+	return *element(x, y);
+}
+
+template<class T>
+const T &TiledArray2D<T>::at(size_t x, size_t y) const
+{
+	assert(x < _width);
+	assert(y < _height);
+	return *element(x, y);
+}
+
+template<class T>
+void TiledArray2D<T>::copy_to(size_t x, size_t y, const Array2DView<T> &out) const
+{
+	assert(x + out.width <= _width);
+	assert(y + out.height <= _height);
+
+	// Copy the run of each row that falls in one tile at a time
+	for(size_t row = 0; row < out.height; row++)
+	{
+		for(size_t col = 0; col < out.width; )
+		{
+			size_t gx = x + col;
+			size_t run = std::min(out.width - col, _tile - (gx % _tile));
+			memcpy(out[row] + col, element(gx, y + row), run * sizeof(T));
+			col += run;
+		}
+	}
+}
+
+template<class T>
+void TiledArray2D<T>::copy_from(size_t x, size_t y, const Array2DView<const T> &in)
+{
+	assert(x + in.width <= _width);
+	assert(y + in.height <= _height);
+
+	for(size_t row = 0; row < in.height; row++)
+	{
+		for(size_t col = 0; col < in.width; )
+		{
+			size_t gx = x + col;
+			size_t run = std::min(in.width - col, _tile - (gx % _tile));
+			memcpy(element(gx, y + row), in[row] + col, run * sizeof(T));
+			col += run;
+		}
+	}
+}
+
+template<class T>
+void TiledArray2D<T>::refresh_ghosts()
+{
+	const size_t g = _ghost;
+	const size_t s = span();
+
+	for(size_t slot = 0; slot < tile_count(); slot++)
+	{
+		Tile_t tile = tile_at(slot);
+		Array2DView<T> dst = block(slot);
+
+		// Each row of the block, from g rows above the tile to g below
+		for(size_t row = 0; row < s; row++)
+		{
+			int64_t gy = (int64_t)(tile.ty * _tile) + (int64_t)row - (int64_t)g;
+			bool ghost_row = (row < g) || (row >= g + _tile);
+			T *out = dst[row];
+
+			if(gy < 0 || gy >= (int64_t)_height)
+			{
+				memset(out, 0, s * sizeof(T));
+				continue;
+			}
+
+			// Interior rows only need their left and right ghosts
+			for(size_t col = 0; col < s; )
+			{
+				int64_t gx = (int64_t)(tile.tx * _tile) + (int64_t)col - (int64_t)g;
+				bool inside = (col >= g) && (col < g + _tile);
+				if(!ghost_row && inside)
+				{
+					// Zero the part of a partial edge tile past the array
+					size_t end = std::min<size_t>(g + _tile, g + (_width - (tile.tx * _tile)));
+					if(col < end)
+						col = end;
+					else
+						out[col++] = T();
+					continue;
+				}
+				if(gx < 0 || gx >= (int64_t)_width)
+				{
+					out[col++] = T();
+					continue;
+				}
+
+				// Copy up to the end of the source tile or of this part of the block
+				size_t limit = inside ? (g + _tile) : ((col < g) ? g : s);
+				size_t run = std::min<size_t>(limit - col, _tile - (gx % _tile));
+				run = std::min<size_t>(run, _width - gx);
+				memcpy(out + col, element(gx, gy), run * sizeof(T));
+				col += run;
+			}
+		}
+	}
+}
+
+template<class T>
+size_t TiledArray2D<T>::hilbert_index(size_t n, size_t x, size_t y)
+{
+	size_t d = 0;
+	for(size_t s = n / 2; s > 0; s /= 2)
+	{
+		size_t rx = (x & s) > 0;
+		size_t ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+
+		// Rotate the quadrant so the curve stays continuous
+		if(ry == 0)
+		{
+			if(rx == 1)
+			{
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+template<class T>
+size_t TiledArray2D<T>::morton_index(size_t x, size_t y)
+{
+	size_t d = 0;
+	for(size_t bit = 0; bit < 32; bit++)
+	{
+		d |= ((x >> bit) & 1) << (2 * bit);
+		d |= ((y >> bit) & 1) << ((2 * bit) + 1);
+	}
+	return d;
+}
+
+#endif // TILED_ARRAY_H